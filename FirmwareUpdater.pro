@@ -12,15 +12,29 @@ DEPENDPATH += D:/mavlink/common
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    devicescanner.cpp \
+    firmwarecatalog.cpp \
+    firmwaredistributor.cpp \
     firmwareudpater.cpp \
+    fleetcommandrunner.cpp \
+    logcollector.cpp \
     main.cpp \
     mainwindow.cpp \
-    mavlinkfilesender.cpp
+    mavlinkfilesender.cpp \
+    metrics.cpp \
+    plinkfanout.cpp
 
 HEADERS += \
+    devicescanner.h \
+    firmwarecatalog.h \
+    firmwaredistributor.h \
     firmwareupdater.h \
+    fleetcommandrunner.h \
+    logcollector.h \
     mainwindow.h \
-    mavlinkfilesender.h
+    mavlinkfilesender.h \
+    metrics.h \
+    plinkfanout.h
 
 FORMS += \
     mainwindow.ui
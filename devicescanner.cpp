@@ -0,0 +1,76 @@
+#include "devicescanner.h"
+
+DeviceScanner::DeviceScanner(QObject *parent)
+    : QObject(parent)
+{
+    scanTimeoutTimer.setSingleShot(true);
+    connect(&scanTimeoutTimer, &QTimer::timeout, this, &DeviceScanner::finishScan);
+}
+
+void DeviceScanner::startScan(const QString &subnetPrefix, quint16 port, int timeoutMs, bool checkBanner)
+{
+    if (scanning) return;
+
+    scanning = true;
+    bannerCheck = checkBanner;
+    foundIps.clear();
+    pendingProbes = 0;
+
+    for (int host = 1; host < 255; ++host) {
+        QString ip = subnetPrefix + QString::number(host);
+        QTcpSocket* socket = new QTcpSocket(this);
+        socket->setProperty("ip", ip);
+        sockets << socket;
+        ++pendingProbes;
+
+        connect(socket, &QTcpSocket::connected, this, [=]() {
+            if (!bannerCheck)
+                probeDone(socket, true);
+        });
+        // sshd greets first: "SSH-2.0-OpenSSH_..."
+        connect(socket, &QTcpSocket::readyRead, this, [=]() {
+            probeDone(socket, socket->readAll().startsWith("SSH-"));
+        });
+        connect(socket, &QTcpSocket::errorOccurred, this, [=]() {
+            probeDone(socket, false);
+        });
+
+        socket->connectToHost(ip, port);
+    }
+
+    scanTimeoutTimer.start(timeoutMs);
+}
+
+void DeviceScanner::probeDone(QTcpSocket *socket, bool found)
+{
+    if (!scanning || socket->property("done").toBool()) return;
+
+    socket->setProperty("done", true);
+    if (found)
+        foundIps << socket->property("ip").toString();
+    socket->abort();
+
+    if (--pendingProbes == 0)
+        finishScan();
+}
+
+void DeviceScanner::finishScan()
+{
+    if (!scanning) return;
+
+    scanning = false;
+    scanTimeoutTimer.stop();
+    for (QTcpSocket* socket : std::as_const(sockets)) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    sockets.clear();
+
+    std::sort(foundIps.begin(), foundIps.end(), [](const QString& a, const QString& b) {
+        return QHostAddress(a).toIPv4Address() < QHostAddress(b).toIPv4Address();
+    });
+
+    qDebug() << "\nScan finished, found:" << foundIps;
+    emit scanFinished(foundIps);
+}
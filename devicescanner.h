@@ -0,0 +1,38 @@
+#ifndef DEVICESCANNER_H
+#define DEVICESCANNER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+
+// Sweeps a /24 subnet with concurrent non-blocking connects to find boards with SSH open
+class DeviceScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeviceScanner(QObject *parent = nullptr);
+
+    // subnetPrefix like "192.168.144." - hosts .1 to .254 are probed at once
+    void startScan(const QString& subnetPrefix, quint16 port = 22, int timeoutMs = 400, bool checkBanner = true);
+    bool isScanning() const { return scanning; }
+
+signals:
+    void scanFinished(const QStringList& ips);
+
+private:
+    void probeDone(QTcpSocket* socket, bool found);
+    void finishScan();
+
+    QList<QTcpSocket*> sockets;
+    QStringList foundIps;
+    QTimer scanTimeoutTimer;
+    int pendingProbes = 0;
+    bool bannerCheck = true;
+    bool scanning = false;
+};
+
+#endif // DEVICESCANNER_H
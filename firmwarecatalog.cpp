@@ -0,0 +1,192 @@
+#include "firmwarecatalog.h"
+
+FirmwareCatalog::FirmwareCatalog(const QString &basePath, QObject *parent)
+    : QObject(parent),
+    baseDirPath(QDir(basePath).absolutePath())
+{
+    debounceTimer.setSingleShot(true);
+    connect(&debounceTimer, &QTimer::timeout, this, &FirmwareCatalog::reindexDirty);
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &FirmwareCatalog::onDirectoryChanged);
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, &FirmwareCatalog::onFileChanged);
+}
+
+// Initial index of every folder, later only changes are picked up
+void FirmwareCatalog::start()
+{
+    QDir().mkpath(baseDirPath);
+    watcher.addPath(baseDirPath);
+    rescanBase();
+}
+
+// Runs on the thread pool
+FirmwareEntry FirmwareCatalog::indexFolder(const QString &basePath, const QString &folder, const FirmwareEntry &previous)
+{
+    FirmwareEntry result;
+    result.folder = folder;
+    result.indexedAt = QDateTime::currentDateTime();
+
+    QDir folderDir(basePath + "/" + folder);
+    QDirIterator dirs(folderDir.absolutePath(), QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (dirs.hasNext())
+        result.directories << folderDir.relativeFilePath(dirs.next());
+
+    QDirIterator it(folderDir.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QFileInfo info = it.fileInfo();
+        QString relativePath = folderDir.relativeFilePath(path);
+
+        FirmwareFileInfo fileInfo;
+        fileInfo.size = info.size();
+        fileInfo.modified = info.lastModified();
+
+        auto old = previous.files.constFind(relativePath);
+        if (old != previous.files.constEnd() && old->size == fileInfo.size && old->modified == fileInfo.modified) {
+            fileInfo.md5 = old->md5;
+        } else {
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly)) {
+                QCryptographicHash hash(QCryptographicHash::Md5);
+                hash.addData(&file);
+                fileInfo.md5 = hash.result().toHex();
+            }
+        }
+
+        result.files.insert(relativePath, fileInfo);
+        result.totalSize += fileInfo.size;
+    }
+
+    QFile cfg(folderDir.absoluteFilePath("wfb_server/wfb_server.cfg"));
+    if (cfg.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&cfg);
+        QString versionLine = in.readLine().trimmed();
+
+        static const QRegularExpression regex(R"#(#wfb_server\s+v(\d+\.\d+\.\d+))#");
+        QRegularExpressionMatch match = regex.match(versionLine);
+        if (match.hasMatch())
+            result.version = match.captured(1);
+    }
+
+    return result;
+}
+
+// First path component below the base dir, empty for the base dir itself
+QString FirmwareCatalog::folderForPath(const QString &path) const
+{
+    QString relativePath = QDir(baseDirPath).relativeFilePath(path);
+    if (relativePath == "." || relativePath.startsWith(".."))
+        return QString();
+    return relativePath.section('/', 0, 0);
+}
+
+void FirmwareCatalog::onDirectoryChanged(const QString &path)
+{
+    QString folder = folderForPath(path);
+    if (folder.isEmpty())
+        rescanBase();
+    else
+        scheduleReindex(folder);
+}
+
+void FirmwareCatalog::onFileChanged(const QString &path)
+{
+    QString folder = folderForPath(path);
+    if (!folder.isEmpty())
+        scheduleReindex(folder);
+}
+
+// Folders added or removed directly under the base dir
+void FirmwareCatalog::rescanBase()
+{
+    QStringList present = QDir(baseDirPath).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+
+    for (const QString& folder : std::as_const(present)) {
+        if (!entries.contains(folder))
+            scheduleReindex(folder);
+    }
+
+    const QStringList known = entries.keys();
+    for (const QString& folder : known) {
+        if (!present.contains(folder)) {
+            entries.remove(folder);
+            emit entryRemoved(folder);
+        }
+    }
+}
+
+// Bursts of changes (e.g. wget writing many files) are coalesced into one re-index
+void FirmwareCatalog::scheduleReindex(const QString &folder)
+{
+    dirtyFolders.insert(folder);
+    debounceTimer.start(300);
+}
+
+void FirmwareCatalog::reindexDirty()
+{
+    const QSet<QString> folders = dirtyFolders;
+    for (const QString& folder : folders) {
+        if (indexingFolders.contains(folder))
+            continue; // picked up again when the running pass finishes
+        dirtyFolders.remove(folder);
+        indexingFolders.insert(folder);
+
+        FirmwareEntry previous = entries.value(folder);
+        QString basePath = baseDirPath;
+        QtConcurrent::run([=]() {
+            bool exists = QDir(basePath + "/" + folder).exists();
+            FirmwareEntry indexed = exists ? indexFolder(basePath, folder, previous) : FirmwareEntry();
+            indexed.folder = folder;
+            QMetaObject::invokeMethod(this, [=]() { onIndexed(indexed, exists); }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void FirmwareCatalog::onIndexed(const FirmwareEntry &indexed, bool exists)
+{
+    indexingFolders.remove(indexed.folder);
+
+    if (!exists) {
+        if (entries.remove(indexed.folder))
+            emit entryRemoved(indexed.folder);
+    } else {
+        entries.insert(indexed.folder, indexed);
+        watchEntry(indexed.folder);
+        qDebug() << "Firmware catalog indexed" << indexed.folder << "version" << indexed.version
+                 << "files" << indexed.files.size();
+        emit entryChanged(indexed.folder);
+    }
+
+    if (dirtyFolders.contains(indexed.folder))
+        debounceTimer.start(300);
+}
+
+// Replaced files drop out of the watcher, so watched paths are refreshed after every pass
+void FirmwareCatalog::watchEntry(const QString &folder)
+{
+    const FirmwareEntry& indexed = entries[folder];
+    QString folderPath = baseDirPath + "/" + folder;
+    QStringList paths = {folderPath};
+    for (const QString& relativePath : indexed.directories)
+        paths << folderPath + "/" + relativePath;
+    for (auto it = indexed.files.constBegin(); it != indexed.files.constEnd(); ++it)
+        paths << folderPath + "/" + it.key();
+
+    QStringList watched = watcher.directories() + watcher.files();
+    for (const QString& path : std::as_const(paths)) {
+        if (!watched.contains(path))
+            watcher.addPath(path);
+    }
+}
+
+QStringList FirmwareCatalog::boardsBehind(const QHash<QString, QString> &runningVersionByIp,
+                                          const QHash<QString, QString> &folderByIp) const
+{
+    QStringList behind;
+    for (auto it = folderByIp.constBegin(); it != folderByIp.constEnd(); ++it) {
+        QVersionNumber local = QVersionNumber::fromString(versionOf(it.value()));
+        QVersionNumber running = QVersionNumber::fromString(runningVersionByIp.value(it.key()));
+        if (!local.isNull() && (running.isNull() || running < local))
+            behind << it.key();
+    }
+    return behind;
+}
@@ -0,0 +1,83 @@
+#ifndef FIRMWARECATALOG_H
+#define FIRMWARECATALOG_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <QVersionNumber>
+#include <QtConcurrent>
+
+struct FirmwareFileInfo {
+    qint64 size = 0;
+    QDateTime modified;
+    QByteArray md5;
+};
+
+struct FirmwareEntry {
+    QString folder;                             // e.g. "75"
+    QString version;                            // from first line of wfb_server/wfb_server.cfg, empty if unknown
+    QHash<QString, FirmwareFileInfo> files;     // relative path -> info
+    QStringList directories;                    // relative subdirectories, for the watcher
+    qint64 totalSize = 0;
+    QDateTime indexedAt;
+};
+
+// In-memory index of all firmware folders under the base path. Indexing runs on the
+// thread pool, the directory is watched and only changed folders are re-indexed;
+// file hashes are reused when size and mtime did not change. Queries never touch the disk.
+class FirmwareCatalog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FirmwareCatalog(const QString& basePath, QObject *parent = nullptr);
+
+    void start();
+
+    QStringList folders() const { return entries.keys(); }
+    bool contains(const QString& folder) const { return entries.contains(folder); }
+    FirmwareEntry entry(const QString& folder) const { return entries.value(folder); }
+    QString versionOf(const QString& folder) const { return entries.value(folder).version; }
+
+    // ips whose running version is older than the local firmware of their folder
+    QStringList boardsBehind(const QHash<QString, QString>& runningVersionByIp,
+                             const QHash<QString, QString>& folderByIp) const;
+
+signals:
+    void entryChanged(const QString& folder);
+    void entryRemoved(const QString& folder);
+
+private slots:
+    void onDirectoryChanged(const QString& path);
+    void onFileChanged(const QString& path);
+    void reindexDirty();
+
+private:
+    static FirmwareEntry indexFolder(const QString& basePath, const QString& folder, const FirmwareEntry& previous);
+
+    QString folderForPath(const QString& path) const;
+    void scheduleReindex(const QString& folder);
+    void rescanBase();
+    void watchEntry(const QString& folder);
+    void onIndexed(const FirmwareEntry& indexed, bool exists);
+
+    const QString baseDirPath;
+    QFileSystemWatcher watcher;
+    QTimer debounceTimer;
+    QHash<QString, FirmwareEntry> entries;
+    QSet<QString> dirtyFolders;
+    QSet<QString> indexingFolders;
+};
+
+#endif // FIRMWARECATALOG_H
@@ -0,0 +1,156 @@
+#include "firmwaredistributor.h"
+
+// Constructor: initializes all configuration parameters
+FirmwareDistributor::FirmwareDistributor(QObject *parent,
+                                         const QString& user,
+                                         const QString& password,
+                                         const QString& plink,
+                                         const QString& pscp,
+                                         const QString& localBasePath)
+    : QObject(parent),
+    remoteUser(user),
+    remotePassword(password),
+    plinkPath(plink),
+    pscpPath(pscp),
+    baseLocalPath(localBasePath)
+{
+}
+
+// Hash of all file paths and contents of <folder>/wfb_server, equal hash = same payload
+QByteArray FirmwareDistributor::folderHash(const QString& dirName)
+{
+    QDir folder(baseLocalPath + dirName + "/wfb_server");
+    QStringList files;
+    QDirIterator it(folder.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files << it.next();
+    files.sort();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    for (const QString& path : std::as_const(files)) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        hash.addData(folder.relativeFilePath(path).toUtf8());
+        hash.addData(&file);
+    }
+    return hash.result();
+}
+
+// Upload to seed, then every holder relays to one pending board per round.
+// Returns boards that hold a verified copy of the release.
+QStringList FirmwareDistributor::distributeGroup(const QString& dirName, const QStringList& ips,
+                                                 const QHash<QString, FirmwareUpdater*>& updaters,
+                                                 const QString& releaseName)
+{
+    QStringList holders;
+    QStringList pending = ips;
+    QStringList failed;
+
+    // Seed: the only copy that crosses the workstation uplink
+    while (holders.isEmpty() && !pending.isEmpty()) {
+        QString seed = pending.takeFirst();
+        FirmwareUpdater* updater = updaters.value(seed);
+        if (updater->uploadRelease(dirName, releaseName) && updater->verifyRelease(dirName, releaseName))
+            holders << seed;
+        else
+            qDebug() << "Seed upload failed:" << seed;
+    }
+
+    // Relays only wait on plink, every pair of a round gets its own thread
+    QThreadPool relayPool;
+
+    int round = 0;
+    while (!holders.isEmpty() && !pending.isEmpty()) {
+        int pairs = qMin(holders.size(), pending.size());
+        relayPool.setMaxThreadCount(pairs);
+        QVector<QFuture<bool>> relays;
+        QStringList targets;
+        for (int i = 0; i < pairs; ++i) {
+            FirmwareUpdater* source = updaters.value(holders.at(i));
+            FirmwareUpdater* target = updaters.value(pending.at(i));
+            targets << pending.at(i);
+            relays << QtConcurrent::run(&relayPool, [=]() {
+                return source->relayReleaseTo(target->deviceIp(), releaseName)
+                       && target->verifyRelease(dirName, releaseName);
+            });
+        }
+        pending = pending.mid(pairs);
+
+        for (int i = 0; i < relays.size(); ++i) {
+            if (relays[i].result())
+                holders << targets.at(i);
+            else
+                failed << targets.at(i);
+        }
+        qDebug() << "Distribution round" << ++round << "holders:" << holders.size() << "pending:" << pending.size();
+    }
+
+    // Relay failed (e.g. no sshpass on the board): fall back to direct uploads, all at once
+    const QStringList fallback = failed + pending;
+    if (fallback.isEmpty())
+        return holders;
+
+    relayPool.setMaxThreadCount(fallback.size());
+    QVector<QFuture<bool>> uploads;
+    for (const QString& ip : fallback) {
+        FirmwareUpdater* updater = updaters.value(ip);
+        uploads << QtConcurrent::run(&relayPool, [=]() {
+            return updater->uploadRelease(dirName, releaseName) && updater->verifyRelease(dirName, releaseName);
+        });
+    }
+    for (int i = 0; i < uploads.size(); ++i) {
+        if (uploads[i].result())
+            holders << fallback.at(i);
+        else
+            qDebug() << "Direct upload failed:" << fallback.at(i);
+    }
+    return holders;
+}
+
+// Distributes every distinct payload as its own tree
+void FirmwareDistributor::startDistribution(const QMap<QString, QString>& targets)
+{
+    QtConcurrent::run([=]() {
+
+        const QString releaseName = FirmwareUpdater::newReleaseName();
+
+        // Host key fetches are independent per board, run them all at once off the global pool
+        QThreadPool connectPool;
+        connectPool.setMaxThreadCount(qMax(1, int(targets.size())));
+
+        QHash<QString, FirmwareUpdater*> updaters;
+        QVector<QFuture<bool>> connects;
+        for (auto it = targets.constBegin(); it != targets.constEnd(); ++it) {
+            FirmwareUpdater* updater = new FirmwareUpdater(nullptr, remoteUser, remotePassword, it.key(),
+                                                           plinkPath, pscpPath, baseLocalPath);
+            updaters.insert(it.key(), updater);
+            connects << QtConcurrent::run(&connectPool, [=]() { return updater->connectToDevice(); });
+        }
+
+        // Boards with identical folders share one tree
+        QMap<QByteArray, QStringList> groups;
+        QHash<QByteArray, QString> groupFolder;
+        int index = 0;
+        for (auto it = targets.constBegin(); it != targets.constEnd(); ++it, ++index) {
+            if (!connects[index].result()) {
+                qDebug() << "Failed to fetch host key:" << it.key();
+                continue;
+            }
+            QByteArray hash = folderHash(it.value());
+            groups[hash] << it.key();
+            groupFolder.insert(hash, it.value());
+        }
+
+        QStringList stagedIps;
+        for (auto it = groups.constBegin(); it != groups.constEnd(); ++it)
+            stagedIps << distributeGroup(groupFolder.value(it.key()), it.value(), updaters, releaseName);
+
+        qDeleteAll(updaters);
+
+        bool success = stagedIps.size() == targets.size();
+        QString message = success ? QString("Firmware distributed to %1 devices.").arg(stagedIps.size())
+                                  : QString("Firmware distributed to %1 of %2 devices.").arg(stagedIps.size()).arg(targets.size());
+        emit distributionFinished(success, releaseName, stagedIps, message);
+    });
+}
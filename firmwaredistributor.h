@@ -0,0 +1,45 @@
+#ifndef FIRMWAREDISTRIBUTOR_H
+#define FIRMWAREDISTRIBUTOR_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include "firmwareupdater.h"
+
+// Distributes a release to many boards: uploads it once per payload to a seed board,
+// then boards relay it to each other over the LAN, doubling the holders every round
+class FirmwareDistributor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FirmwareDistributor(QObject *parent,
+                                 const QString& user,
+                                 const QString& password,
+                                 const QString& plink,
+                                 const QString& pscp,
+                                 const QString& localBasePath);
+
+    // targets: device ip -> local firmware folder
+    void startDistribution(const QMap<QString, QString>& targets);
+
+signals:
+    void distributionFinished(bool success, const QString& releaseName,
+                              const QStringList& stagedIps, const QString& message);
+
+private:
+    const QString remoteUser;
+    const QString remotePassword;
+    const QString plinkPath;
+    const QString pscpPath;
+    const QString baseLocalPath;
+
+    QByteArray folderHash(const QString& dirName);
+    QStringList distributeGroup(const QString& dirName, const QStringList& ips,
+                                const QHash<QString, FirmwareUpdater*>& updaters,
+                                const QString& releaseName);
+};
+#endif // FIRMWAREDISTRIBUTOR_H
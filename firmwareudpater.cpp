@@ -39,20 +39,46 @@ bool FirmwareUpdater::executePlinkCommand(const QString& command, int timeoutMs)
     return (process.exitCode() == 0);
 }
 
+// Executes plink command with given timeout and captures stdout
+bool FirmwareUpdater::executePlinkCommand(const QString& command, QString& output, int timeoutMs)
+{
+    QStringList arguments = {
+        "-pw", remotePassword,
+        "-batch",
+        "-hostkey", serverHostKey,
+        QString("%1@%2").arg(remoteUser, currentRemoteIp),
+        command
+    };
+
+    QProcess process;
+    process.start(plinkPath, arguments);
+    if (!process.waitForFinished(timeoutMs))
+        return false;
+
+    output = process.readAllStandardOutput();
+    return (process.exitCode() == 0);
+}
+
 // Extracts SSH host key for current device
 QString FirmwareUpdater::fetchHostKey()
+{
+    return fetchHostKey(plinkPath, remoteUser, remotePassword, currentRemoteIp);
+}
+
+// Blocking, needs no updater instance, so fleet-wide tools can call it from a worker thread
+QString FirmwareUpdater::fetchHostKey(const QString& plink, const QString& user, const QString& password, const QString& ip)
 {
     QStringList arguments = {
         "-batch",
         "-v",
         "-ssh",
-        "-pw", remotePassword,
-        QString("%1@%2").arg(remoteUser, currentRemoteIp),
+        "-pw", password,
+        QString("%1@%2").arg(user, ip),
         "exit"
     };
 
     QProcess process;
-    process.setProgram(plinkPath);
+    process.setProgram(plink);
     process.setArguments(arguments);
     process.setProcessChannelMode(QProcess::MergedChannels);
     process.start();
@@ -84,60 +110,36 @@ QString FirmwareUpdater::fetchHostKey()
     }
 }
 
-// Checks if remote directory exists
-bool FirmwareUpdater::directoryExistsOnOrangePi(const QString& dirName)
+// Release folder name, e.g. wfb_server_191026_153000
+QString FirmwareUpdater::newReleaseName()
 {
-    QString command = QString("sudo test -d /usr/sbin/%1 && echo exists").arg(dirName);
-    QStringList arguments = {
-        "-pw", remotePassword,
-        "-batch",
-        "-hostkey", serverHostKey,
-        QString("%1@%2").arg(remoteUser, currentRemoteIp),
-        command
-    };
-
-    QProcess process;
-    process.start(plinkPath, arguments);
-    if (!process.waitForFinished(5000)) return false;
-
-    QString output = process.readAllStandardOutput().trimmed();
-    return output.contains("exists");
+    return QString("wfb_server_%1").arg(QDateTime::currentDateTime().toString("ddMMyy_hhmmss"));
 }
 
-// Creates backup folder if needed, adds suffix _date_N if name conflict
-bool FirmwareUpdater::makeBackupIfExists()
+// Remote firmware folder of a staged release
+QString FirmwareUpdater::releaseFolderPath(const QString& releaseName)
 {
-    QString dirName = "wfb_server";
-
-    if (!directoryExistsOnOrangePi(dirName))
-        return true;
-
-    QString date = QDate::currentDate().toString("ddMMyy");
-    QString baseBackupName = QString("%1_backup_%2").arg(dirName, date);
-    QString backupName = baseBackupName;
-    int counter = 1;
-
-    // Handle multiple backups in one day
-    while (directoryExistsOnOrangePi(backupName)) {
-        backupName = QString("%1_%2").arg(baseBackupName).arg(counter++);
-    }
-
-    QString moveCommand = QString("sudo mv /usr/sbin/%1 /usr/sbin/%2").arg(dirName, backupName);
-    return executePlinkCommand(moveCommand, 10000);
+    return "/usr/sbin/wfb_releases/" + releaseName + "/wfb_server";
 }
 
-// Creates fresh folder for firmware
-bool FirmwareUpdater::createRemoteFolder()
+// Fetches host key, must succeed before any other remote step
+bool FirmwareUpdater::connectToDevice()
 {
-    QString createCommand = "sudo mkdir -p /usr/sbin/wfb_server/";
-    return executePlinkCommand(createCommand, 10000);
+    QString hostKey = fetchHostKey();
+    if (hostKey.isEmpty())
+        return false;
+    this->serverHostKey = hostKey;
+    return true;
 }
 
-// Copies firmware files to remote device
-bool FirmwareUpdater::copyFirmwareFolder(const QString& localDirName)
+// Copies firmware files into a fresh release folder while the running service stays untouched
+bool FirmwareUpdater::stageFirmwareFolder(const QString& localDirName, const QString& releaseName)
 {
     QString localFolderPath = baseLocalPath + localDirName + "/wfb_server"; // localDirName = folder
-    const QString remoteFolderPath = "/usr/sbin/";
+    const QString remoteReleasePath = "/usr/sbin/wfb_releases/" + releaseName;
+
+    if (!executePlinkCommand(QString("sudo mkdir -p %1").arg(remoteReleasePath), 10000))
+        return false;
 
     QStringList scpArgs = {
         "-pw", remotePassword,
@@ -145,7 +147,7 @@ bool FirmwareUpdater::copyFirmwareFolder(const QString& localDirName)
         "-r",
         "-batch",
         localFolderPath,
-        QString("%1@%2:%3").arg(remoteUser, currentRemoteIp, remoteFolderPath)
+        QString("%1@%2:%3/").arg(remoteUser, currentRemoteIp, remoteReleasePath)
     };
 
     QProcess scpProcess;
@@ -157,12 +159,84 @@ bool FirmwareUpdater::copyFirmwareFolder(const QString& localDirName)
 
     if (scpProcess.exitCode() != 0) return false;
 
-    QString chmodCommand = "sudo chmod -R a+x /usr/sbin/wfb_server";
+    stagedFolderPath = releaseFolderPath(releaseName);
+    QString chmodCommand = QString("sudo chmod -R a+x %1").arg(stagedFolderPath);
+    return executePlinkCommand(chmodCommand, 10000);
+}
+
+// Release was already delivered to this board (e.g. relayed by FirmwareDistributor)
+bool FirmwareUpdater::usePrestagedFolder(const QString& releaseName)
+{
+    stagedFolderPath = releaseFolderPath(releaseName);
+    QString chmodCommand = QString("sudo chmod -R a+x %1").arg(stagedFolderPath);
     return executePlinkCommand(chmodCommand, 10000);
 }
 
+bool FirmwareUpdater::uploadRelease(const QString& localDirName, const QString& releaseName)
+{
+    return stageFirmwareFolder(localDirName, releaseName);
+}
+
+bool FirmwareUpdater::verifyRelease(const QString& localDirName, const QString& releaseName)
+{
+    stagedFolderPath = releaseFolderPath(releaseName);
+    return verifyStagedFolder(localDirName);
+}
+
+// Copies a staged release from this board to another board over the local LAN (needs sshpass on the board)
+bool FirmwareUpdater::relayReleaseTo(const QString& targetIp, const QString& releaseName)
+{
+    const QString remoteReleasePath = "/usr/sbin/wfb_releases/" + releaseName;
+    QString sshOptions = "-o StrictHostKeyChecking=no -o UserKnownHostsFile=/dev/null";
+    QString target = QString("%1@%2").arg(remoteUser, targetIp);
+
+    QString relayCommand = QString(
+                               "sshpass -p '%1' ssh %2 %3 'mkdir -p %4' && "
+                               "sshpass -p '%1' scp -rp %2 %5 %3:%4/"
+                               ).arg(remotePassword, sshOptions, target, remoteReleasePath, releaseFolderPath(releaseName));
+    return executePlinkCommand(relayCommand, 60000);
+}
+
+// Compares md5 of every staged file with the local copy
+bool FirmwareUpdater::verifyStagedFolder(const QString& localDirName)
+{
+    QDir localFolder(baseLocalPath + localDirName + "/wfb_server");
+    QHash<QString, QString> localHashes;
+    QDirIterator it(localFolder.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QFile file(it.next());
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        hash.addData(&file);
+        localHashes.insert("./" + localFolder.relativeFilePath(file.fileName()), hash.result().toHex());
+    }
+
+    QString output;
+    QString md5Command = QString("cd %1 && find . -type f -exec md5sum {} +").arg(stagedFolderPath);
+    if (!executePlinkCommand(md5Command, output, 15000))
+        return false;
+
+    // md5sum output: "<hash>  ./<path>"
+    int matched = 0;
+    for (const QString& line : output.split('\n', Qt::SkipEmptyParts)) {
+        QString hash = line.section(' ', 0, 0);
+        QString path = line.section(' ', 2).trimmed();
+        if (!localHashes.contains(path))
+            continue;
+        if (localHashes.value(path) != hash) {
+            qDebug() << "Staged file mismatch:" << path;
+            return false;
+        }
+        ++matched;
+    }
+
+    qDebug() << "\nVerified staged files:" << matched << "of" << localHashes.size();
+    return matched == localHashes.size();
+}
+
 // Update WLAN config (only for device with IP ending with ".75")
-bool FirmwareUpdater::updateWlanConfigIfNeeded()
+bool FirmwareUpdater::updateWlanConfigIfNeeded(const QString& cfgPath)
 {
     // only for 75 IP
     if (!currentRemoteIp.endsWith(".75"))
@@ -212,11 +286,56 @@ bool FirmwareUpdater::updateWlanConfigIfNeeded()
 
     // Replace wlan = ... line in config file
     QString sedCommand = QString(
-                             "sudo sed -i '/^\\[wlan\\]/,/^\\[/ s/^wlan =.*/wlan = %1/' /usr/sbin/wfb_server/wfb_server.cfg"
-                             ).arg(wlanLine);
+                             "sudo sed -i '/^\\[wlan\\]/,/^\\[/ s/^wlan =.*/wlan = %1/' %2"
+                             ).arg(wlanLine, cfgPath);
     return executePlinkCommand(sedCommand, 10000);
 }
 
+// Atomically repoints /usr/sbin/wfb_server symlink to the staged folder (rename over the link),
+// remembering the old target in /usr/sbin/wfb_server.previous
+bool FirmwareUpdater::activateStagedFolder()
+{
+    // First run on a board: the live folder is still a plain directory, move it aside once
+    // as wfb_server_backup_<date>[_N]; the name is picked on the board, so no extra round trips
+    QString migrateCommand = QString(
+                                 "if [ -d /usr/sbin/wfb_server ] && [ ! -L /usr/sbin/wfb_server ]; then "
+                                 "b=/usr/sbin/wfb_server_backup_%1; n=$b; i=1; "
+                                 "while [ -e $n ]; do n=${b}_$i; i=$((i+1)); done; "
+                                 "sudo mv /usr/sbin/wfb_server $n && sudo ln -s $n /usr/sbin/wfb_server; fi"
+                                 ).arg(QDate::currentDate().toString("ddMMyy"));
+
+    QString swapCommand = QString(
+                              "if [ -e /usr/sbin/wfb_server ]; then sudo ln -sfn \"$(readlink -f /usr/sbin/wfb_server)\" /usr/sbin/wfb_server.previous; fi && "
+                              "sudo ln -sfn %1 /usr/sbin/wfb_server.next && "
+                              "sudo mv -T /usr/sbin/wfb_server.next /usr/sbin/wfb_server"
+                              ).arg(stagedFolderPath);
+    return executePlinkCommand(migrateCommand + " && " + swapCommand, 10000);
+}
+
+// One-step rollback: repoint /usr/sbin/wfb_server to the previous folder
+bool FirmwareUpdater::rollbackToPrevious()
+{
+    QString rollbackCommand =
+        "test -L /usr/sbin/wfb_server.previous && "
+        "sudo ln -sfn \"$(readlink -f /usr/sbin/wfb_server.previous)\" /usr/sbin/wfb_server.next && "
+        "sudo ln -sfn \"$(readlink -f /usr/sbin/wfb_server)\" /usr/sbin/wfb_server.previous && "
+        "sudo mv -T /usr/sbin/wfb_server.next /usr/sbin/wfb_server";
+    return executePlinkCommand(rollbackCommand, 10000);
+}
+
+// Deletes every release under /usr/sbin/wfb_releases except the current and the previous target
+bool FirmwareUpdater::pruneOldReleases()
+{
+    QString pruneCommand =
+        "cur=\"$(readlink -f /usr/sbin/wfb_server)/\"; prev=\"$(readlink -f /usr/sbin/wfb_server.previous)/\"; "
+        "[ -d \"$cur\" ] || exit 1; "
+        "for d in /usr/sbin/wfb_releases/*/; do d=${d%/}; [ -d \"$d\" ] || continue; "
+        "case \"$cur\" in \"$d\"/*) continue;; esac; "
+        "case \"$prev\" in \"$d\"/*) continue;; esac; "
+        "sudo rm -rf \"$d\"; done";
+    return executePlinkCommand(pruneCommand, 30000);
+}
+
 // Restarts service
 bool FirmwareUpdater::restartService()
 {  
@@ -231,44 +350,167 @@ bool FirmwareUpdater::rebootDevice()
     return executePlinkCommand(rebootCommand, 3000);
 }
 
-// Full firmware update pipeline
-void FirmwareUpdater::startUpdate(const QString& localDirName)
+// Extracts X.Y.Z from a "#wfb_server vX.Y.Z" config header line
+QString FirmwareUpdater::parseFirmwareVersion(const QString& text)
 {
-    QtConcurrent::run([=]() {
+    static const QRegularExpression regex(R"#(#wfb_server\s+v(\d+\.\d+\.\d+))#");
+    QRegularExpressionMatch match = regex.match(text);
+    return match.hasMatch() ? match.captured(1) : QString();
+}
 
-        QString hostKey = fetchHostKey();
-        if (hostKey.isEmpty()) {
-            emit updateFinished(false, "Failed to fetch host key!");
+// Reads "#wfb_server vX.Y.Z" from the first line of the local config
+QString FirmwareUpdater::localFirmwareVersion(const QString& localDirName)
+{
+    QFile file(baseLocalPath + localDirName + "/wfb_server/wfb_server.cfg");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QString();
+
+    QTextStream in(&file);
+    return parseFirmwareVersion(in.readLine());
+}
+
+// Short TCP connect to port 22
+bool FirmwareUpdater::isSshPortOpen(int timeoutMs)
+{
+    QTcpSocket socket;
+    socket.connectToHost(currentRemoteIp, 22);
+    return socket.waitForConnected(timeoutMs);
+}
+
+// Waits until the board went down, came back, wfb.service is active and runs the expected version
+bool FirmwareUpdater::waitForDeviceReady(const QString& expectedVersion, int timeoutMs)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // Old sshd may still answer for a moment after "reboot" was issued
+    while (elapsed.elapsed() < 15000 && isSshPortOpen(300))
+        QThread::msleep(200);
+
+    int backoffMs = 100;
+    while (elapsed.elapsed() < timeoutMs) {
+        if (isSshPortOpen(300)) {
+            QString output;
+            QString checkCommand = "systemctl is-active wfb.service && head -n 1 /usr/sbin/wfb_server/wfb_server.cfg";
+            if (executePlinkCommand(checkCommand, output, 5000)
+                && (expectedVersion.isEmpty() || parseFirmwareVersion(output) == expectedVersion)) {
+                qDebug() << "\nDevice ready:" << currentRemoteIp << output.trimmed();
+                return true;
+            }
+        }
+        QThread::msleep(backoffMs);
+        backoffMs = qMin(backoffMs * 2, 1000);
+    }
+
+    qDebug() << "Device not ready in time:" << currentRemoteIp;
+    return false;
+}
+
+// Updates block on plink/pscp and wait minutes for the reboot, so they get their own pool
+// instead of starving the global one (device pings, catalog indexing, host key fetches)
+QThreadPool* FirmwareUpdater::updatePool()
+{
+    static QThreadPool pool;
+    pool.setMaxThreadCount(qMax(pool.maxThreadCount(), pool.activeThreadCount() + 1)); // one thread per running update
+    return &pool;
+}
+
+// Records update duration/result metrics and reports the result
+void FirmwareUpdater::finishUpdate(bool success, const QString& message)
+{
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    QString device = QString("device=\"%1\"").arg(currentRemoteIp);
+    registry.histogram("firmware_update_duration_seconds", "Firmware update duration from start to result.", device,
+                       {10, 30, 60, 120, 180, 300, 600})->observe(updateTimer.elapsed() / 1000.0);
+    registry.counter("firmware_updates_total", "Firmware updates by result.",
+                     device + QString(",result=\"%1\"").arg(success ? "success" : "failure"))->inc();
+
+    emit updateFinished(success, message);
+}
+
+// Full firmware update pipeline: stage and verify while wfb keeps running, then swap and restart
+void FirmwareUpdater::startUpdate(const QString& localDirName, const QString& prestagedRelease)
+{
+    QtConcurrent::run(updatePool(), [=]() {
+
+        updateTimer.start();
+
+        if (!connectToDevice()) {
+            finishUpdate(false, "Failed to fetch host key!");
             return;
         }
-        this->serverHostKey = hostKey;
 
-        if (!makeBackupIfExists()) {
-            emit updateFinished(false, "Backup creation error!");
+        bool staged = prestagedRelease.isEmpty() ? stageFirmwareFolder(localDirName, newReleaseName())
+                                                 : usePrestagedFolder(prestagedRelease);
+        if (!staged) {
+            finishUpdate(false, "Copy Firmware error!");
             return;
         }
 
-        if (!createRemoteFolder()) {
-            emit updateFinished(false, "Directory creation error!");
+        if (!verifyStagedFolder(localDirName)) {
+            finishUpdate(false, "Firmware verification error!");
             return;
         }
 
-        if (!copyFirmwareFolder(localDirName)) {
-            emit updateFinished(false, "Copy Firmware error!");
+        if (!updateWlanConfigIfNeeded(stagedFolderPath + "/wfb_server.cfg")) {
+            finishUpdate(false, "WLAN config update error!");
             return;
         }
 
-        if (!updateWlanConfigIfNeeded()) {
-            emit updateFinished(false, "WLAN config update error!");
+        if (!activateStagedFolder()) {
+            finishUpdate(false, "Firmware activation error!");
             return;
         }
 
         if (!restartService()) {
-            emit updateFinished(false, "Service Restart error!");
+            if (rollbackToPrevious() && restartService())
+                finishUpdate(false, "Service Restart error! Previous firmware restored.");
+            else
+                finishUpdate(false, "Service Restart error! Rollback failed.");
             return;
         }
 
+        // Housekeeping only, the new firmware is already live
+        if (!pruneOldReleases())
+            qDebug() << "Failed to prune old releases on" << currentRemoteIp;
+
         rebootDevice();
-        emit updateFinished(true, "Firmware successfully installed!" );
+
+        if (!waitForDeviceReady(localFirmwareVersion(localDirName))) {
+            finishUpdate(false, "Firmware installed, but device is not ready after reboot!");
+            return;
+        }
+
+        qint64 updateToReadyMs = updateTimer.elapsed();
+        MetricsRegistry::instance().histogram("firmware_update_to_ready_seconds", "Time from update start until the rebooted board runs the new firmware.",
+                                              QString("device=\"%1\"").arg(currentRemoteIp),
+                                              {30, 60, 90, 120, 180, 300, 600})->observe(updateToReadyMs / 1000.0);
+        emit deviceReady(currentRemoteIp, updateToReadyMs);
+        finishUpdate(true, QString("Firmware successfully installed! Device ready in %1 s.")
+                                   .arg(updateToReadyMs / 1000.0, 0, 'f', 1));
+    });
+}
+
+// Switches back to the previously installed firmware folder and restarts service
+void FirmwareUpdater::startRollback()
+{
+    QtConcurrent::run(updatePool(), [=]() {
+
+        if (!connectToDevice()) {
+            emit updateFinished(false, "Failed to fetch host key!");
+            return;
+        }
+
+        if (!rollbackToPrevious()) {
+            emit updateFinished(false, "No previous firmware to roll back to!");
+            return;
+        }
+
+        if (!restartService()) {
+            emit updateFinished(false, "Service Restart error!");
+            return;
+        }
+
+        emit updateFinished(true, "Previous firmware restored!");
     });
 }
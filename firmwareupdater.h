@@ -9,6 +9,16 @@
 #include <QtConcurrent>
 #include <QFile>
 #include <QTextStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QThreadPool>
+#include "metrics.h"
 
 class FirmwareUpdater : public QObject
 {
@@ -24,11 +34,25 @@ public:
                              const QString& localBasePath)/*,
                              const QString& hostKey)*/;
 
-    void startUpdate(const QString& dirName);
+    void startUpdate(const QString& dirName, const QString& prestagedRelease = QString());
+    void startRollback();
     QString fetchHostKey();
+    static QString fetchHostKey(const QString& plink, const QString& user, const QString& password, const QString& ip);
+    QString deviceIp() const { return currentRemoteIp; }
+
+    static QString newReleaseName();
+    static QString releaseFolderPath(const QString& releaseName);
+    static QString parseFirmwareVersion(const QString& text);
+
+    // Blocking steps used by FirmwareDistributor, call from a worker thread
+    bool connectToDevice();
+    bool uploadRelease(const QString& dirName, const QString& releaseName);
+    bool relayReleaseTo(const QString& targetIp, const QString& releaseName);
+    bool verifyRelease(const QString& dirName, const QString& releaseName);
 
 signals:
     void updateFinished(bool success, const QString& message);
+    void deviceReady(const QString& ip, qint64 updateToReadyMs);
 
 private:
     const QString remoteUser;
@@ -39,14 +63,27 @@ private:
     const QString baseLocalPath;
     QString serverHostKey;
 
+    QString stagedFolderPath;   // /usr/sbin/wfb_releases/<release>/wfb_server
+    QElapsedTimer updateTimer;
+
+    static QThreadPool* updatePool();
+    void finishUpdate(bool success, const QString& message);
+
     bool executePlinkCommand(const QString& command, int timeoutMs = 10000);
+    bool executePlinkCommand(const QString& command, QString& output, int timeoutMs = 10000);
 
-    bool directoryExistsOnOrangePi(const QString& dirName);
-    bool makeBackupIfExists();
-    bool createRemoteFolder();
-    bool copyFirmwareFolder(const QString& dirName);
-    bool updateWlanConfigIfNeeded();
+    bool stageFirmwareFolder(const QString& dirName, const QString& releaseName);
+    bool usePrestagedFolder(const QString& releaseName);
+    bool verifyStagedFolder(const QString& dirName);
+    bool updateWlanConfigIfNeeded(const QString& cfgPath);
+    bool activateStagedFolder();
+    bool rollbackToPrevious();
+    bool pruneOldReleases();
     bool restartService();
     bool rebootDevice();
+
+    QString localFirmwareVersion(const QString& dirName);
+    bool isSshPortOpen(int timeoutMs);
+    bool waitForDeviceReady(const QString& expectedVersion, int timeoutMs = 180000);
 };
 #endif // FIRMWAREUPDATER_H
@@ -0,0 +1,65 @@
+#include "fleetcommandrunner.h"
+
+// Constructor: initializes all configuration parameters
+FleetCommandRunner::FleetCommandRunner(QObject *parent, PlinkFanOut* sharedFanOut)
+    : QObject(parent),
+    fanOut(sharedFanOut)
+{
+    connect(fanOut, &PlinkFanOut::outputReady, this, [=](int jobId, const QString& ip, const QByteArray& data, bool isStdErr) {
+        if (!jobs.contains(jobId)) return;
+        Run& run = running[ip];
+        readLines(ip, isStdErr ? run.stderrTail : run.stdoutTail, data, isStdErr);
+    });
+    connect(fanOut, &PlinkFanOut::jobFinished, this, [=](int jobId, const QString& ip, int exitCode, const QString& error) {
+        if (!jobs.remove(jobId)) return;
+        finishDevice(ip, exitCode, error);
+        if (jobs.isEmpty())
+            emit allFinished(outputGroups);
+    });
+}
+
+void FleetCommandRunner::run(const QString& command, const QStringList& ips, int timeoutMs)
+{
+    if (isRunning()) return;
+
+    running.clear();
+    outputGroups.clear();
+
+    if (ips.isEmpty()) {
+        emit allFinished(outputGroups);
+        return;
+    }
+
+    for (const QString& ip : ips)
+        jobs.insert(fanOut->run(ip, command, timeoutMs), ip);
+}
+
+// Emits every complete line as soon as it arrives
+void FleetCommandRunner::readLines(const QString& ip, QByteArray& tail, const QByteArray& data, bool isStdErr)
+{
+    tail += data;
+    int newline;
+    while ((newline = tail.indexOf('\n')) >= 0) {
+        QString line = QString::fromUtf8(tail.left(newline)).trimmed();
+        tail.remove(0, newline + 1);
+        running[ip].output += line + "\n";
+        emit lineReceived(ip, line, isStdErr);
+    }
+}
+
+void FleetCommandRunner::finishDevice(const QString& ip, int exitCode, const QString& error)
+{
+    Run run = running.take(ip);
+    for (QByteArray* tail : {&run.stdoutTail, &run.stderrTail}) {
+        if (!tail->isEmpty()) {
+            QString line = QString::fromUtf8(*tail).trimmed();
+            run.output += line + "\n";
+            emit lineReceived(ip, line, tail == &run.stderrTail);
+        }
+    }
+    if (!error.isEmpty())
+        emit lineReceived(ip, error, true);
+
+    outputGroups[run.output].append(ip);
+    emit deviceFinished(ip, exitCode);
+}
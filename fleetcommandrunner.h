@@ -0,0 +1,44 @@
+#ifndef FLEETCOMMANDRUNNER_H
+#define FLEETCOMMANDRUNNER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include "plinkfanout.h"
+
+// Runs one shell command on many boards at once over plink, streams output line by line
+// and groups boards that produced identical output
+class FleetCommandRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FleetCommandRunner(QObject *parent, PlinkFanOut* sharedFanOut);
+
+    void run(const QString& command, const QStringList& ips, int timeoutMs = 30000);
+    bool isRunning() const { return !jobs.isEmpty(); }
+
+signals:
+    void lineReceived(const QString& ip, const QString& line, bool isStdErr);
+    void deviceFinished(const QString& ip, int exitCode);
+    // output -> boards that printed exactly this output
+    void allFinished(const QMap<QString, QStringList>& outputGroups);
+
+private:
+    struct Run {
+        QByteArray stdoutTail;      // incomplete last line
+        QByteArray stderrTail;
+        QString output;             // kept for grouping
+    };
+
+    PlinkFanOut* fanOut;
+    QHash<int, QString> jobs;           // own jobs on the shared fan-out, id -> ip
+    QHash<QString, Run> running;
+    QMap<QString, QStringList> outputGroups;
+
+    void readLines(const QString& ip, QByteArray& tail, const QByteArray& data, bool isStdErr);
+    void finishDevice(const QString& ip, int exitCode, const QString& error);
+};
+#endif // FLEETCOMMANDRUNNER_H
@@ -0,0 +1,139 @@
+#include "logcollector.h"
+
+// Constructor: initializes all configuration parameters
+LogCollector::LogCollector(QObject *parent,
+                           PlinkFanOut* sharedFanOut,
+                           const QString& logBasePath)
+    : QObject(parent),
+    baseLogPath(logBasePath),
+    fanOut(sharedFanOut)
+{
+    // Written as it arrives, nothing is kept in memory
+    connect(fanOut, &PlinkFanOut::outputReady, this, [=](int jobId, const QString& ip, const QByteArray& data, bool isStdErr) {
+        if (!jobs.contains(jobId)) return;
+        auto it = running.find(ip);
+        if (isStdErr || it == running.end() || it->writeFailed) return;
+        if (!it->file && !openStream(ip, it.value())) {
+            it->writeFailed = true;
+            return;
+        }
+        if (it->file->write(data) != data.size())
+            it->writeFailed = true;
+        it->bytes += data.size();
+    });
+    connect(fanOut, &PlinkFanOut::jobFinished, this, [=](int jobId, const QString& ip, int exitCode, const QString& error) {
+        if (!jobs.remove(jobId)) return;
+        if (!error.isEmpty())
+            qDebug() << "Log collection failed:" << ip << error;
+        auto it = running.find(ip);
+        if (it != running.end()) {
+            if (it->committing)
+                finishCommit(ip, exitCode == 0);
+            else
+                finishStream(ip, exitCode == 0);
+        }
+        if (jobs.isEmpty())
+            emit collectionFinished(succeeded, total);
+    });
+}
+
+// Journal continues after the saved cursor (--cursor-file, systemd 242+),
+// log files are sent only if modified since the last stamp.
+// Cursor and stamp go to .new files, commitCommand() makes them current.
+QString LogCollector::remoteCommand() const
+{
+    QString resume = incremental
+                         ? QString("[ -f $C.journal.cursor ] && cp $C.journal.cursor $C.journal.cursor.new; ")
+                         : QString();
+    QString newer = incremental
+                        ? QString("$([ -f $C.stamp ] && echo -newer $C.stamp)")
+                        : QString();
+    return QString(
+               "C=/var/tmp/firmwareupdater; rm -f $C.journal.cursor.new $C.stamp.new; %1"
+               "{ journalctl -u wfb.service --no-pager -o short-iso --cursor-file=$C.journal.cursor.new; "
+               "touch $C.stamp.new; "
+               "for f in $(find /var/log /usr/sbin/wfb_server/ -maxdepth 1 -type f -name 'wfb*.log' %2); "
+               "do echo \"===== $f\"; cat \"$f\"; done; } 2>&1 | gzip -c"
+               ).arg(resume, newer);
+}
+
+// Run only after the local .log.gz is closed, an interrupted transfer leaves the old cursor in place
+QString LogCollector::commitCommand()
+{
+    return QString(
+        "C=/var/tmp/firmwareupdater; "
+        "[ -f $C.journal.cursor.new ] && mv $C.journal.cursor.new $C.journal.cursor; "
+        "mv $C.stamp.new $C.stamp");
+}
+
+void LogCollector::collect(const QStringList& ips, bool sinceLastCollection, int timeoutMs)
+{
+    if (isRunning()) return;
+
+    incremental = sinceLastCollection;
+    total = ips.size();
+    succeeded = 0;
+
+    if (ips.isEmpty()) {
+        emit collectionFinished(0, 0);
+        return;
+    }
+
+    for (const QString& ip : ips) {
+        running.insert(ip, Stream());
+        jobs.insert(fanOut->run(ip, remoteCommand(), timeoutMs), ip);
+    }
+}
+
+bool LogCollector::openStream(const QString& ip, Stream& stream)
+{
+    QDir().mkpath(baseLogPath + ip);
+    QString filePath = QString("%1%2/wfb_%3.log.gz").arg(baseLogPath, ip, QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+
+    QFile* file = new QFile(filePath, this);
+    if (!file->open(QIODevice::WriteOnly)) {
+        qDebug() << "Cannot open log file:" << filePath;
+        delete file;
+        return false;
+    }
+    stream.file = file;
+    return true;
+}
+
+void LogCollector::finishStream(const QString& ip, bool success)
+{
+    Stream& stream = running[ip];
+    success = success && !stream.writeFailed;
+
+    if (stream.file) {
+        stream.filePath = stream.file->fileName();
+        if (!stream.file->flush())
+            success = false;
+        stream.file->close();
+        if (!success) {
+            stream.file->remove();
+            stream.filePath.clear();
+        }
+        stream.file->deleteLater();
+        stream.file = nullptr;
+    }
+
+    if (!success) {
+        finishCommit(ip, false);
+        return;
+    }
+
+    stream.committing = true;
+    jobs.insert(fanOut->run(ip, commitCommand(), 30000), ip);
+}
+
+void LogCollector::finishCommit(const QString& ip, bool success)
+{
+    Stream stream = running.take(ip);
+    if (stream.committing && !success)
+        qDebug() << "Logs saved but cursor not committed, next run repeats them:" << ip;
+
+    if (success)
+        ++succeeded;
+    emit deviceCollected(ip, success, stream.filePath, stream.bytes);
+}
@@ -0,0 +1,57 @@
+#ifndef LOGCOLLECTOR_H
+#define LOGCOLLECTOR_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include "plinkfanout.h"
+
+// Pulls wfb.service journal and wfb_server log files from many boards at once.
+// Logs are gzipped on the board and streamed straight into <logBasePath>/<ip>/wfb_<time>.log.gz.
+// Incremental runs continue from a cursor kept on each board (/var/tmp/firmwareupdater.*),
+// which only moves forward once the local file has been written completely.
+class LogCollector : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LogCollector(QObject *parent,
+                          PlinkFanOut* sharedFanOut,
+                          const QString& logBasePath);
+
+    void collect(const QStringList& ips, bool sinceLastCollection = true, int timeoutMs = 120000);
+    bool isRunning() const { return !jobs.isEmpty(); }
+
+signals:
+    void deviceCollected(const QString& ip, bool success, const QString& filePath, qint64 bytes);
+    void collectionFinished(int succeeded, int total);
+
+private:
+    struct Stream {
+        QFile* file = nullptr;      // opened on the first data, so idle boards hold no handle
+        qint64 bytes = 0;
+        bool writeFailed = false;
+        bool committing = false;    // log saved, second plink call moving the cursor
+        QString filePath;
+    };
+
+    const QString baseLogPath;
+    PlinkFanOut* fanOut;
+    QHash<int, QString> jobs;           // own jobs on the shared fan-out, id -> ip
+
+    bool incremental = true;
+    int total = 0;
+    int succeeded = 0;
+    QHash<QString, Stream> running;
+
+    QString remoteCommand() const;
+    static QString commitCommand();
+    bool openStream(const QString& ip, Stream& stream);
+    void finishStream(const QString& ip, bool success);
+    void finishCommit(const QString& ip, bool success);
+};
+#endif // LOGCOLLECTOR_H
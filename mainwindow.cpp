@@ -8,9 +8,45 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
     firmwareBasePath = "D:/localFtpFiles/main/";
+    scanSubnet = "192.168.144.";
+    logBasePath = "D:/localFtpFiles/logs/";
 
     setupDevices();
 
+    catalog = new FirmwareCatalog(firmwareBasePath, this);
+    connect(catalog, &FirmwareCatalog::entryChanged, this, &MainWindow::updateAllVersions);
+    connect(catalog, &FirmwareCatalog::entryRemoved, this, &MainWindow::updateAllVersions);
+    catalog->start();
+
+    // One plink queue and host key cache for every fleet tool
+    plinkFanOut = new PlinkFanOut(this, "root", "orangepi", "C:/Program Files/PuTTY/plink.exe");
+
+    // Firmware version actually running on each board, read when it comes online
+    connect(plinkFanOut, &PlinkFanOut::outputReady, this, [=](int jobId, const QString& ip, const QByteArray& data, bool isStdErr){
+        Q_UNUSED(ip);
+        auto it = versionProbeOutput.find(jobId);
+        if (it != versionProbeOutput.end() && !isStdErr)
+            it.value() += data;
+    });
+    connect(plinkFanOut, &PlinkFanOut::jobFinished, this, [=](int jobId, const QString& ip, int exitCode, const QString& error){
+        auto it = versionProbeOutput.find(jobId);
+        if (it == versionProbeOutput.end()) return; // job of another fleet tool
+        QString version = FirmwareUpdater::parseFirmwareVersion(QString::fromUtf8(it.value()));
+        versionProbeOutput.erase(it);
+        if (exitCode != 0 || version.isEmpty()) {
+            qDebug() << "Cannot read running firmware version:" << ip << error;
+            return;
+        }
+        runningVersions.insert(ip, version);
+        updateAllVersions();
+    });
+
+    metricsPort = quint16(qEnvironmentVariableIntValue("FIRMWAREUPDATER_METRICS_PORT"));
+    if (metricsPort != 0) {
+        metricsServer = new MetricsServer(this);
+        metricsServer->start(metricsPort);
+    }
+
     pingTimer = new QTimer(this);
     connect(pingTimer, &QTimer::timeout, this, &MainWindow::checkAllDevices);
     pingTimer->start(5000); // periodic ping every 5 sec
@@ -24,17 +60,71 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->Update100, &QPushButton::clicked, this, &MainWindow::updateFirmware100);
     connect(ui->Update125, &QPushButton::clicked, this, &MainWindow::updateFirmware125);
     connect(ui->Update185, &QPushButton::clicked, this, &MainWindow::updateFirmware185);
+    connect(ui->UpdateAll, &QPushButton::clicked, this, &MainWindow::onUpdateAllClicked);
 
     checkAllDevices(); // initial check on app start
 
+    scanner = new DeviceScanner(this);
+    connect(scanner, &DeviceScanner::scanFinished, this, [=](const QStringList& ips){
+        for (const QString& ip : ips)
+            addDeviceRow(ip);
+        ui->ScanNetwork->setEnabled(true);
+        checkAllDevices();
+        updateAllVersions();
+    });
+    connect(ui->ScanNetwork, &QPushButton::clicked, this, &MainWindow::onScanNetworkClicked);
+    onScanNetworkClicked(); // discover boards beyond the default ones
+
     fileSender = new MavlinkFileSender(this);
     fileSender->setTarget("10.59.59.197", 14550); // ip, port of target board to send via MavlinkFTP
+    //fileSender->addLink("10.59.60.197", 14550); // second link to the same board (e.g. LTE), chunks are striped over both
 
     connect(fileSender, &MavlinkFileSender::fileSent, this, [=](bool success, const QString &msg){
         QMessageBox::information(this, success ? "Success" : "Error", msg);
     });
 
+    connect(fileSender, &MavlinkFileSender::syncFinished, this, [=](bool success, const QString &msg){
+        QMessageBox::information(this, success ? "Success" : "Error", msg);
+    });
+
+    fleetRunner = new FleetCommandRunner(this, plinkFanOut);
+    fleetOutput = new QPlainTextEdit(this);
+    fleetOutput->setWindowFlags(Qt::Window);
+    fleetOutput->setWindowTitle("Fleet output");
+    fleetOutput->setReadOnly(true);
+    fleetOutput->setStyleSheet("font: 8pt \"Lucida Console\";");
+    fleetOutput->resize(700, 400);
+
+    connect(fleetRunner, &FleetCommandRunner::lineReceived, this, [=](const QString& ip, const QString& line, bool isStdErr){
+        fleetOutput->appendPlainText(QString("[%1]%2 %3").arg(ip, isStdErr ? " !" : "", line));
+    });
+    connect(fleetRunner, &FleetCommandRunner::deviceFinished, this, [=](const QString& ip, int exitCode){
+        fleetOutput->appendPlainText(QString("[%1] exit code %2").arg(ip).arg(exitCode));
+    });
+    connect(fleetRunner, &FleetCommandRunner::allFinished, this, [=](const QMap<QString, QStringList>& outputGroups){
+        fleetOutput->appendPlainText("\n===== Summary =====");
+        for (auto it = outputGroups.constBegin(); it != outputGroups.constEnd(); ++it)
+        {
+            fleetOutput->appendPlainText(QString("--- %1 device(s): %2").arg(it.value().size()).arg(it.value().join(", ")));
+            fleetOutput->appendPlainText(it.key().isEmpty() ? "(no output)" : it.key().trimmed());
+        }
+        ui->RunOnFleet->setEnabled(true);
+    });
+    connect(ui->RunOnFleet, &QPushButton::clicked, this, &MainWindow::onRunOnFleetClicked);
+
+    logCollector = new LogCollector(this, plinkFanOut, logBasePath);
+    connect(logCollector, &LogCollector::deviceCollected, this, [=](const QString& ip, bool success, const QString& filePath, qint64 bytes){
+        qDebug() << "Logs" << ip << (success ? "saved to" : "failed") << filePath << bytes << "bytes";
+    });
+    connect(logCollector, &LogCollector::collectionFinished, this, [=](int succeeded, int total){
+        ui->CollectLogs->setEnabled(true);
+        QMessageBox::information(this, succeeded == total ? "Success" : "Error",
+                                 QString("Logs collected from %1 of %2 devices into %3").arg(succeeded).arg(total).arg(logBasePath));
+    });
+    connect(ui->CollectLogs, &QPushButton::clicked, this, &MainWindow::onCollectLogsClicked);
+
     connect(ui->sendFile, &QPushButton::clicked, this, &MainWindow::onSendFileClicked);
+    connect(ui->syncFolder, &QPushButton::clicked, this, &MainWindow::onSyncFolderClicked);
 }
 
 MainWindow::~MainWindow()
@@ -46,11 +136,90 @@ MainWindow::~MainWindow()
 void MainWindow::setupDevices()
 {
     devices = {
-        {"192.168.144.75",  "75",  ui->labelConnectionStatus75,  ui->Update75 }, //10.59.59.95
-        {"192.168.144.100", "100", ui->labelConnectionStatus100, ui->Update100},
-        {"192.168.144.125", "125", ui->labelConnectionStatus125, ui->Update125},
-        {"192.168.144.185", "185", ui->labelConnectionStatus185, ui->Update185}
+        {"192.168.144.75",  "75",  ui->labelConnectionStatus75, ui->WfbVersion75,  ui->Update75,  ui->Rollback75 }, //10.59.59.95
+        {"192.168.144.100", "100", ui->labelConnectionStatus100, ui->WfbVersion100, ui->Update100, ui->Rollback100},
+        {"192.168.144.125", "125", ui->labelConnectionStatus125, ui->WfbVersion125, ui->Update125, ui->Rollback125},
+        {"192.168.144.185", "185", ui->labelConnectionStatus185, ui->WfbVersion185, ui->Update185, ui->Rollback185}
     };
+
+    for (auto& device : devices)
+    {
+        bindDeviceMetrics(device);
+        QString ip = device.ip;
+        connect(device.rollbackButton, &QPushButton::clicked, this, [=]() { startFirmwareRollback(ip); });
+    }
+}
+
+// Looks up the per-device metric instances once, when the row is created
+void MainWindow::bindDeviceMetrics(DeviceInfo& device)
+{
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    QString labels = QString("device=\"%1\"").arg(device.ip);
+    device.probeLatency = registry.histogram("device_probe_latency_seconds", "TCP connect time to port 22.", labels,
+                                             {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1});
+    device.up = registry.gauge("device_up", "1 if port 22 answered on the last probe.", labels);
+    device.transitionsUp = registry.counter("device_link_transitions_total", "Reachability changes per device.",
+                                            labels + ",direction=\"up\"");
+    device.transitionsDown = registry.counter("device_link_transitions_total", "Reachability changes per device.",
+                                              labels + ",direction=\"down\"");
+}
+
+// Add a status column for a discovered device, same widgets as the default ones
+void MainWindow::addDeviceRow(const QString& ip)
+{
+    for (const auto& device : devices)
+    {
+        if (device.ip == ip) return;
+    }
+
+    QString folder = ip.section('.', 3, 3);
+
+    QLabel* nameLabel = new QLabel(folder, this);
+    nameLabel->setStyleSheet("background-color: rgb(255, 255, 255); font: 700 9pt \"Bahnschrift\"; color: rgb(0, 0, 0);");
+    nameLabel->setFrameShape(QFrame::StyledPanel);
+    nameLabel->setAlignment(Qt::AlignCenter);
+    nameLabel->setMinimumWidth(190); // same as the default columns, the scroll area takes the overflow
+
+    QLabel* statusLabel = new QLabel("Checking for connection...", this);
+    statusLabel->setStyleSheet("background-color: rgb(255, 255, 255); color: rgb(0, 0, 0);");
+    statusLabel->setFrameShape(QFrame::Panel);
+    statusLabel->setAlignment(Qt::AlignCenter);
+
+    QLabel* versionLabel = new QLabel("Loaded Firmware ...", this);
+    versionLabel->setStyleSheet("background-color: rgb(255, 255, 255); font: 8pt \"Lucida Console\"; color: rgb(0, 0, 0);");
+    versionLabel->setFrameShape(QFrame::StyledPanel);
+    versionLabel->setAlignment(Qt::AlignCenter);
+
+    QPushButton* updateButton = new QPushButton("Update", this);
+    updateButton->setStyleSheet("font: 9pt \"Segoe MDL2 Assets\";");
+    updateButton->setEnabled(false);
+    connect(updateButton, &QPushButton::clicked, this, [=]() { startFirmwareUpdate(ip, folder); });
+
+    QPushButton* rollbackButton = new QPushButton("Rollback", this);
+    rollbackButton->setStyleSheet("font: 9pt \"Segoe MDL2 Assets\";");
+    rollbackButton->setEnabled(false);
+    connect(rollbackButton, &QPushButton::clicked, this, [=]() { startFirmwareRollback(ip); });
+
+    QVBoxLayout* column = new QVBoxLayout();
+    column->addWidget(nameLabel);
+    column->addWidget(statusLabel);
+    column->addWidget(versionLabel);
+    column->addWidget(updateButton);
+    column->addWidget(rollbackButton);
+    ui->horizontalLayout_2->addLayout(column);
+
+    DeviceInfo device{ip, folder, statusLabel, versionLabel, updateButton, rollbackButton};
+    bindDeviceMetrics(device);
+    devices.append(device);
+    qDebug() << "Discovered device added:" << ip;
+}
+
+// Sweep the subnet for boards with SSH open
+void MainWindow::onScanNetworkClicked()
+{
+    if (scanner->isScanning()) return;
+    ui->ScanNetwork->setEnabled(false);
+    scanner->startScan(scanSubnet);
 }
 
 // Simple TCP ping to port 22
@@ -68,7 +237,11 @@ void MainWindow::checkAllDevices()
     {
         if (updatingDevices.contains(device.ip)) continue;
         QtConcurrent::run([=]() {
+            QElapsedTimer probeTimer;
+            probeTimer.start();
             bool reachable = isHostReachable(device.ip, 22, 1000);
+            if (reachable)
+                device.probeLatency->observe(probeTimer.nsecsElapsed() / 1e9);
             QMetaObject::invokeMethod(this, [=]() {
                 updateDeviceStatus(device, reachable);
             }, Qt::QueuedConnection);
@@ -79,18 +252,37 @@ void MainWindow::checkAllDevices()
 // Update label and button based on ping result
 void MainWindow::updateDeviceStatus(const DeviceInfo& device, bool reachable)
 {
+    auto previous = lastReachable.constFind(device.ip);
+    bool cameOnline = reachable && (previous == lastReachable.constEnd() || !previous.value());
+    if (previous != lastReachable.constEnd() && previous.value() != reachable)
+        (reachable ? device.transitionsUp : device.transitionsDown)->inc();
+    lastReachable.insert(device.ip, reachable);
+    if (cameOnline)
+        probeRunningVersion(device.ip);
+    device.up->set(reachable ? 1 : 0);
+
     if (reachable)
     {
         device.statusLabel->setText("Connected");
         device.statusLabel->setStyleSheet("color: green; background-color: rgb(255, 255, 255); font: 8pt Lucida Console; ");
-        device.updateButton->setEnabled(true);
+        device.rollbackButton->setEnabled(true);
     }
     else
     {
         device.statusLabel->setText("Not Connected");
         device.statusLabel->setStyleSheet("color: red; background-color: rgb(255, 255, 255); font: 8pt Lucida Console; ");
-        device.updateButton->setEnabled(false);
+        device.rollbackButton->setEnabled(false);
     }
+    updateUpdateButton(device);
+}
+
+// Update needs a reachable board and a local firmware folder for it in the catalog
+void MainWindow::updateUpdateButton(const DeviceInfo& device)
+{
+    bool hasFirmware = catalog->contains(device.folder);
+    device.updateButton->setEnabled(lastReachable.value(device.ip, false) && hasFirmware);
+    device.updateButton->setToolTip(hasFirmware ? QString()
+                                                : QString("No firmware folder %1 in %2").arg(device.folder, firmwareBasePath));
 }
 
 // Start downloading firmware from FTP using wget
@@ -140,55 +332,68 @@ void MainWindow::onDownloadFirmwareClicked()
     wgetProcess->start("C:/msys64/usr/bin/wget.exe", args);
 }
 
-// Parse downloaded firmware versions from config files
+// Show local firmware versions from the catalog (no disk access here)
 void MainWindow::updateAllVersions()
 {
-    struct Device {
-        QString folder;
-        QLabel* versionLabel;
-    };
-
-    QVector<Device> devices = {
-        {"75", ui->WfbVersion75},
-        {"100", ui->WfbVersion100},
-        {"125", ui->WfbVersion125},
-        {"185", ui->WfbVersion185}
-    };
+    QHash<QString, QString> folderByIp;
+    for (const auto& device : devices)
+        folderByIp.insert(device.ip, device.folder);
+    const QStringList behind = catalog->boardsBehind(runningVersions, folderByIp);
 
     for (const auto& device : devices)
     {
-        QString cfgPath = firmwareBasePath + device.folder + "/wfb_server/wfb_server.cfg";
-        QFile file(cfgPath);
+        updateUpdateButton(device);
 
-        if (!file.exists()) {
+        QString version = catalog->versionOf(device.folder);
+        if (version.isEmpty()) {
             device.versionLabel->setText("Loaded Firmware: ---");
             continue;
         }
 
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            device.versionLabel->setText("Loaded Firmware: ---");
-            continue;
-        }
+        QString text = "Loaded Firmware: " + version;
+        if (runningVersions.contains(device.ip) && behind.contains(device.ip))
+            text += " (board: " + runningVersions.value(device.ip) + ")";
+        device.versionLabel->setText(text);
+    }
+}
 
-        QTextStream in(&file);
-        QString versionLine = in.readLine().trimmed();
-        file.close();
+// Reads the version header of the live config, the result lands in runningVersions
+void MainWindow::probeRunningVersion(const QString& ip)
+{
+    versionProbeOutput.insert(plinkFanOut->run(ip, "head -n 1 /usr/sbin/wfb_server/wfb_server.cfg", 10000), QByteArray());
+}
 
-        static const QRegularExpression regex(R"#(#wfb_server\s+v(\d+\.\d+\.\d+))#");
-        QRegularExpressionMatch match = regex.match(versionLine);
+// Launch update process for selected device
+void MainWindow::startFirmwareUpdate(const QString& ip, const QString& folder, const QString& prestagedRelease)
+{
+    updatingDevices.insert(ip);
+    FirmwareUpdater *updater = new FirmwareUpdater(this,
+                                                   "root", "orangepi", ip,
+                                                   "C:/Program Files/PuTTY/plink.exe", "C:/Program Files/PuTTY/pscp.exe",
+                                                   "D:/localFtpFiles/main/"
+                                                   );
 
-        if (match.hasMatch()) {
-            QString version = match.captured(1);
-            device.versionLabel->setText("Loaded Firmware: " + version);
-        } else {
-            device.versionLabel->setText("Loaded Firmware: ---");
-        }
-    }
+    connect(updater, &FirmwareUpdater::deviceReady, this, [=](const QString& readyIp, qint64 updateToReadyMs){
+        qDebug() << "\nUpdate-to-ready for" << readyIp << ":" << updateToReadyMs << "ms";
+    });
+
+    connect(updater, &FirmwareUpdater::updateFinished, this, [=](bool success, const QString& message){
+        QMessageBox::information(this, success ? "Success" : "Error", message);
+        updatingDevices.remove(ip);
+        probeRunningVersion(ip); // a failed update may have rolled back
+        updater->deleteLater();
+    });
+
+    updater->startUpdate(folder, prestagedRelease);
 }
 
-// Launch update process for selected device
-void MainWindow::startFirmwareUpdate(const QString& ip, const QString& folder)
+// Switch the device back to the firmware that ran before the last update
+void MainWindow::startFirmwareRollback(const QString& ip)
 {
+    if (updatingDevices.contains(ip)) return;
+    if (QMessageBox::question(this, "Rollback", QString("Restore the previous firmware on %1?").arg(ip)) != QMessageBox::Yes)
+        return;
+
     updatingDevices.insert(ip);
     FirmwareUpdater *updater = new FirmwareUpdater(this,
                                                    "root", "orangepi", ip,
@@ -199,10 +404,55 @@ void MainWindow::startFirmwareUpdate(const QString& ip, const QString& folder)
     connect(updater, &FirmwareUpdater::updateFinished, this, [=](bool success, const QString& message){
         QMessageBox::information(this, success ? "Success" : "Error", message);
         updatingDevices.remove(ip);
+        if (success)
+            probeRunningVersion(ip);
         updater->deleteLater();
     });
 
-    updater->startUpdate(folder);
+    updater->startRollback();
+}
+
+// Distribute firmware to all connected devices board-to-board, then install on each
+void MainWindow::onUpdateAllClicked()
+{
+    QMap<QString, QString> targets;
+    for (const auto& device : devices)
+    {
+        // Boards without a local firmware folder (e.g. just discovered) are left out
+        if (device.updateButton->isEnabled() && catalog->contains(device.folder) && !updatingDevices.contains(device.ip))
+            targets.insert(device.ip, device.folder);
+    }
+    if (targets.isEmpty()) {
+        QMessageBox::warning(this, "WARNING", "No connected devices with local firmware to update.");
+        return;
+    }
+
+    for (const QString& ip : targets.keys())
+        updatingDevices.insert(ip);
+
+    FirmwareDistributor *distributor = new FirmwareDistributor(this,
+                                                               "root", "orangepi",
+                                                               "C:/Program Files/PuTTY/plink.exe", "C:/Program Files/PuTTY/pscp.exe",
+                                                               "D:/localFtpFiles/main/"
+                                                               );
+
+    connect(distributor, &FirmwareDistributor::distributionFinished, this,
+            [=](bool success, const QString& releaseName, const QStringList& stagedIps, const QString& message){
+                qDebug() << "\nDistribution:" << message;
+                if (!success)
+                    QMessageBox::information(this, "Error", message);
+
+                for (auto it = targets.constBegin(); it != targets.constEnd(); ++it)
+                {
+                    if (stagedIps.contains(it.key()))
+                        startFirmwareUpdate(it.key(), it.value(), releaseName);
+                    else
+                        updatingDevices.remove(it.key());
+                }
+                distributor->deleteLater();
+            });
+
+    distributor->startDistribution(targets);
 }
 
 // Per-device button handlers
@@ -211,6 +461,50 @@ void MainWindow::updateFirmware100() { startFirmwareUpdate("192.168.144.100", "1
 void MainWindow::updateFirmware125() { startFirmwareUpdate("192.168.144.125", "125"); }
 void MainWindow::updateFirmware185() { startFirmwareUpdate("192.168.144.185", "185"); }
 
+// Asks for a shell command and runs it on all connected devices at once
+void MainWindow::onRunOnFleetClicked()
+{
+    QString command = QInputDialog::getText(this, "Run on Fleet", "Command:", QLineEdit::Normal, "systemctl is-active wfb.service").trimmed();
+    if (command.isEmpty()) return;
+
+    QStringList ips;
+    for (const auto& device : devices)
+    {
+        if (lastReachable.value(device.ip, false) && !updatingDevices.contains(device.ip))
+            ips << device.ip;
+    }
+    if (ips.isEmpty()) {
+        QMessageBox::warning(this, "WARNING", "No connected devices.");
+        return;
+    }
+
+    fleetOutput->clear();
+    fleetOutput->appendPlainText(QString("$ %1  (%2 devices)\n").arg(command).arg(ips.size()));
+    fleetOutput->show();
+    fleetOutput->raise();
+
+    ui->RunOnFleet->setEnabled(false);
+    fleetRunner->run(command, ips);
+}
+
+// Collects new journal/log entries from all connected devices since the last collection
+void MainWindow::onCollectLogsClicked()
+{
+    QStringList ips;
+    for (const auto& device : devices)
+    {
+        if (lastReachable.value(device.ip, false))
+            ips << device.ip;
+    }
+    if (ips.isEmpty()) {
+        QMessageBox::warning(this, "WARNING", "No connected devices.");
+        return;
+    }
+
+    ui->CollectLogs->setEnabled(false);
+    logCollector->collect(ips);
+}
+
 // Opens file dialog and sends selected file via MavlinkFileSender
 void MainWindow::onSendFileClicked()
 {
@@ -220,4 +514,13 @@ void MainWindow::onSendFileClicked()
     fileSender->sendFile(filePath);
 }
 
+// Opens folder dialog and syncs the selected folder (missing/changed files only) via MavlinkFileSender
+void MainWindow::onSyncFolderClicked()
+{
+    QString dirPath = QFileDialog::getExistingDirectory(this, "Select folder to sync");
+    if (dirPath.isEmpty()) return;
+
+    fileSender->syncDirectory(dirPath, "/" + QDir(dirPath).dirName());
+}
+
 
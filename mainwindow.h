@@ -4,11 +4,21 @@
 #include <QMainWindow>
 #include <QTimer>
 #include <QSet>
+#include <QHash>
 #include <QVector>
 #include <QRegularExpression>
 #include <QTcpSocket>
 #include <QFileDialog>
 #include "firmwareupdater.h"
+#include "firmwaredistributor.h"
+#include "devicescanner.h"
+#include "metrics.h"
+#include "fleetcommandrunner.h"
+#include "logcollector.h"
+#include "plinkfanout.h"
+#include "firmwarecatalog.h"
+#include <QPlainTextEdit>
+#include <QInputDialog>
 #include "mavlinkfilesender.h"
 
 QT_BEGIN_NAMESPACE
@@ -19,7 +29,14 @@ struct DeviceInfo {
     QString ip;
     QString folder;
     QLabel* statusLabel;
+    QLabel* versionLabel;
     QPushButton* updateButton;
+    QPushButton* rollbackButton;
+    // bound once per row, probes only touch the atomics
+    MetricsRegistry::Histogram* probeLatency = nullptr;
+    MetricsRegistry::Gauge* up = nullptr;
+    MetricsRegistry::Counter* transitionsUp = nullptr;
+    MetricsRegistry::Counter* transitionsDown = nullptr;
     //QString hostKey;
 };
 
@@ -42,21 +59,45 @@ private slots:
     void updateFirmware125();
     void updateFirmware185();
     void onSendFileClicked();
+    void onSyncFolderClicked();
+    void onUpdateAllClicked();
+    void onScanNetworkClicked();
+    void onRunOnFleetClicked();
+    void onCollectLogsClicked();
 
 private:
     Ui::MainWindow *ui;
     QTimer *pingTimer;
     QVector<DeviceInfo> devices;
     QSet<QString> updatingDevices;
+    QHash<QString, bool> lastReachable;
+    MetricsServer *metricsServer = nullptr;
+    quint16 metricsPort = 0; // from FIRMWAREUPDATER_METRICS_PORT, 0 (default) disables the /metrics endpoint
     QString firmwareBasePath;
     QString baseFtpUrl;
 
     MavlinkFileSender *fileSender = nullptr;
+    DeviceScanner *scanner = nullptr;
+    FleetCommandRunner *fleetRunner = nullptr;
+    QPlainTextEdit *fleetOutput = nullptr;
+    LogCollector *logCollector = nullptr;
+    FirmwareCatalog *catalog = nullptr;
+    PlinkFanOut *plinkFanOut = nullptr;           // shared by version probes, fleet runner and log collector
+    QHash<int, QByteArray> versionProbeOutput;    // by job id
+    QHash<QString, QString> runningVersions; // version from each board's wfb_server.cfg per device ip
+    QString logBasePath;
+    QString scanSubnet;
+
 
     void setupDevices();
+    void addDeviceRow(const QString& ip);
+    static void bindDeviceMetrics(DeviceInfo& device);
     void updateDeviceStatus(const DeviceInfo& device, bool reachable);
+    void updateUpdateButton(const DeviceInfo& device);
     void updateAllVersions();
-    void startFirmwareUpdate(const QString& ip, const QString& folder);
+    void probeRunningVersion(const QString& ip);
+    void startFirmwareUpdate(const QString& ip, const QString& folder, const QString& prestagedRelease = QString());
+    void startFirmwareRollback(const QString& ip);
     bool isHostReachable(const QString& ip, quint16 port = 22, int timeout = 1000);
 };
 #endif // MAINWINDOW_H
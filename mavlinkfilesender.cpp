@@ -1,21 +1,90 @@
 #include "mavlinkfilesender.h"
 
+// CRC32 as computed by the board for CalcFileCRC32 (reflected 0xEDB88320, initial 0, no final xor)
+// Runs on a worker thread, the table is built once in a thread-safe static
+static quint32 crc32ForFile(const QString& path)
+{
+    static const QVector<quint32> table = []() {
+        QVector<quint32> t(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return 0;
+
+    quint32 crc = 0;
+    while (!f.atEnd()) {
+        const QByteArray block = f.read(64 * 1024);
+        for (char byte : block)
+            crc = table[(crc ^ static_cast<quint8>(byte)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
 MavlinkFileSender::MavlinkFileSender(QObject *parent)
     : QObject(parent)
 {
     udpSocket = new QUdpSocket(this);
     connect(udpSocket, &QUdpSocket::readyRead, this, &MavlinkFileSender::onSocketReadyRead);
     connect(&ackTimeoutTimer, &QTimer::timeout, this, &MavlinkFileSender::onAckTimeout);
+    connect(&chunkTimer, &QTimer::timeout, this, &MavlinkFileSender::onChunkTimer);
+    connect(&crcTimer, &QTimer::timeout, this, &MavlinkFileSender::onCrcTimer);
 }
 
 void MavlinkFileSender::setTarget(const QString &ip, quint16 port)
 {
-    targetIp = ip;
-    targetPort = port;
+    links.clear();
+    controlLink = 0;
+    addLink(ip, port);
+}
+
+void MavlinkFileSender::addLink(const QString &ip, quint16 port)
+{
+    Link link;
+    link.address = QHostAddress(ip);
+    link.port = port;
+    bindLinkMetrics(link);
+    links.append(link);
+    bindThroughputMetric();
+}
+
+// Looks up metric instances once, packet paths only touch the atomics
+void MavlinkFileSender::bindLinkMetrics(Link &link)
+{
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    QString labels = QString("target=\"%1:%2\"").arg(link.address.toString()).arg(link.port);
+    link.rttHistogram = registry.histogram("mavlink_ftp_rtt_seconds", "MAVLink FTP request to ACK round trip time.", labels,
+                                           {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1});
+    link.retransmitCounter = registry.counter("mavlink_ftp_retransmits_total", "MAVLink FTP packets resent after timeout or NAK.", labels);
+    link.nakCounter = registry.counter("mavlink_ftp_naks_total", "MAVLink FTP NAK responses received.", labels);
+    link.bytesCounter = registry.counter("mavlink_ftp_bytes_sent_total", "MAVLink FTP file payload bytes sent.", labels);
+    link.srttGauge = registry.gauge("mavlink_ftp_link_srtt_milliseconds", "Smoothed RTT used for chunk allocation.", labels);
+    link.lossGauge = registry.gauge("mavlink_ftp_link_loss_permille", "Estimated request loss used for chunk allocation.", labels);
+}
+
+void MavlinkFileSender::bindThroughputMetric()
+{
+    QStringList targets;
+    for (const Link& link : std::as_const(links))
+        targets << QString("%1:%2").arg(link.address.toString()).arg(link.port);
+    throughputGauge = MetricsRegistry::instance().gauge("mavlink_ftp_last_transfer_bytes_per_second",
+                                                        "Throughput of the last completed file upload.",
+                                                        QString("target=\"%1\"").arg(targets.join('+')));
 }
 
 void MavlinkFileSender::sendFile(const QString &localFilePath)
 {
+    if (links.isEmpty()) {
+        emit fileSent(false, "No target set");
+        return;
+    }
     if (file.isOpen()) {
         file.close();
     }
@@ -25,6 +94,9 @@ void MavlinkFileSender::sendFile(const QString &localFilePath)
         return;
     }
 
+    syncMode = false;
+    possibleDuplicateAcks = 0;
+    currentRemotePath = QFileInfo(localFilePath).fileName();
     bytesSent = 0;
     session = 0;
     retryCount = 0;
@@ -33,6 +105,64 @@ void MavlinkFileSender::sendFile(const QString &localFilePath)
     sendCreateFile();
 }
 
+// Syncs a local directory tree to the board: lists the remote side first,
+// then uploads only missing or changed files back to back
+void MavlinkFileSender::syncDirectory(const QString &localDirPath, const QString &remoteDirPath)
+{
+    if (links.isEmpty()) {
+        emit syncFinished(false, "No target set");
+        return;
+    }
+
+    QDir localDir(localDirPath);
+    if (!localDir.exists()) {
+        emit syncFinished(false, "Directory not found: " + localDirPath);
+        return;
+    }
+
+    if (file.isOpen()) {
+        file.close();
+    }
+
+    syncMode = true;
+    syncRemoteRoot = remoteDirPath.endsWith('/') ? remoteDirPath.chopped(1) : remoteDirPath;
+    syncRemoteDirs.clear();
+    localEntries.clear();
+    remoteDirs.clear();
+    remoteFiles.clear();
+    mkdirQueue.clear();
+    crcQueue.clear();
+    pendingCrcs.clear();
+    remoteCrcs.clear();
+    localCrcs.clear();
+    localCrcsReady = false;
+    ++syncGeneration;
+    uploadQueue.clear();
+    filesUploaded = 0;
+    possibleDuplicateAcks = 0;
+    session = 0;
+    retryCount = 0;
+
+    QDirIterator it(localDirPath, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QFileInfo info = it.fileInfo();
+        QString remotePath = syncRemoteRoot + "/" + localDir.relativeFilePath(path);
+        if (info.isDir())
+            syncRemoteDirs << remotePath;
+        else
+            localEntries.append({path, remotePath, info.size()});
+    }
+
+    // parents sort before their children, so mkdir order stays valid
+    std::sort(syncRemoteDirs.begin(), syncRemoteDirs.end());
+    syncRemoteDirs.prepend(syncRemoteRoot);
+
+    listQueue = syncRemoteDirs;
+    listOffset = 0;
+    sendListDirectory();
+}
+
 void MavlinkFileSender::sendCreateFile()
 {
     mavlink_message_t message{};
@@ -46,7 +176,7 @@ void MavlinkFileSender::sendCreateFile()
     ftp_pkt.payload[0] = 6; // OpCode CreateFile
     ftp_pkt.payload[1] = session;
 
-    QByteArray name = QFileInfo(file.fileName()).fileName().toUtf8();
+    QByteArray name = currentRemotePath.toUtf8();
     int nameLen = qMin(name.size(), 239 - 2); // leave 2 bytes for OpCode and Session
     memcpy(&ftp_pkt.payload[2], name.constData(), nameLen);
 
@@ -54,31 +184,202 @@ void MavlinkFileSender::sendCreateFile()
 
     uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
     uint16_t len = mavlink_msg_to_send_buffer(buffer, &message);
-    lastSentPacket = QByteArray(reinterpret_cast<char*>(buffer), len);
-    lastOpcodeSent = 6;
-
-    udpSocket->writeDatagram(lastSentPacket, QHostAddress(targetIp), targetPort);
+    transferTimer.start();
+    sendControlPacket(QByteArray(reinterpret_cast<char*>(buffer), len), 6);
 
     qDebug() << "CreateFile sent for" << name;
+}
 
-    ackTimeoutTimer.start(300);
+// Lower is better: time to get one more chunk through this link
+double MavlinkFileSender::linkCost(const Link &link) const
+{
+    return link.srttMs * (link.inFlight + 1) / qMax(0.05, 1.0 - link.loss);
+}
+
+int MavlinkFileSender::bestLink() const
+{
+    int best = 0;
+    for (int i = 1; i < links.size(); ++i) {
+        if (linkCost(links[i]) < linkCost(links[best]))
+            best = i;
+    }
+    return best;
 }
 
-void MavlinkFileSender::sendNextChunk()
+// Free link with the lowest cost; links far slower/lossier than the best one are left idle
+// so they do not hold back the tail of the file
+int MavlinkFileSender::pickLinkForChunk() const
+{
+    double bestIdleCost = 0;
+    for (int i = 0; i < links.size(); ++i) {
+        double idleCost = links[i].srttMs / qMax(0.05, 1.0 - links[i].loss);
+        if (i == 0 || idleCost < bestIdleCost)
+            bestIdleCost = idleCost;
+    }
+
+    // ACKs of a receiver without echo cannot be matched to chunks, keep one in flight
+    if (!receiverEchoesRequest && !pendingChunks.isEmpty())
+        return -1;
+
+    int picked = -1;
+    for (int i = 0; i < links.size(); ++i) {
+        const Link& link = links[i];
+        if (link.inFlight >= maxInFlightPerLink)
+            continue;
+        if (link.srttMs / qMax(0.05, 1.0 - link.loss) > 4 * bestIdleCost)
+            continue;
+        if (picked < 0 || linkCost(link) < linkCost(links[picked]))
+            picked = i;
+    }
+    return picked;
+}
+
+void MavlinkFileSender::updateLinkRtt(Link &link, double rttMs)
+{
+    link.rttHistogram->observe(rttMs / 1000.0);
+    link.srttMs = 0.875 * link.srttMs + 0.125 * rttMs;
+    link.srttGauge->set(qint64(link.srttMs));
+}
+
+void MavlinkFileSender::updateLinkLoss(Link &link, bool lost)
+{
+    link.loss = 0.9 * link.loss + (lost ? 0.1 : 0.0);
+    link.lossGauge->set(qint64(link.loss * 1000));
+}
+
+// Keeps every usable link busy with WriteFile chunks, TerminateSession once all are acknowledged
+void MavlinkFileSender::fillChunkWindow()
 {
     if (!file.isOpen()) {
-        emit fileSent(false, "File not open");
+        finishTransfer(false, "File not open");
         return;
     }
 
-    if (file.atEnd()) {
+    int linkIndex;
+    while (!file.atEnd() && (linkIndex = pickLinkForChunk()) >= 0) {
+        QByteArray chunk = file.read(chunkSize);
+
+        mavlink_message_t message{};
+        mavlink_file_transfer_protocol_t ftp_pkt{};
+        memset(&ftp_pkt, 0, sizeof(ftp_pkt));
+
+        ftp_pkt.target_network = 0;
+        ftp_pkt.target_system = 1;
+        ftp_pkt.target_component = 1;
+
+        ftp_pkt.payload[0] = 7; // OpCode WriteFile
+        ftp_pkt.payload[1] = session;
+
+        // write 4-byte offset (little-endian)
+        ftp_pkt.payload[2] = (bytesSent & 0xFF);         // bytesSent(0) & 11111111(0xFF) = 00000000
+        ftp_pkt.payload[3] = ((bytesSent >> 8) & 0xFF);  // bytesSent >> 8 => 00000000 00000000 & 11111111 => 00000000 00000000
+        ftp_pkt.payload[4] = ((bytesSent >> 16) & 0xFF); // bytesSent >> 16 => 00000000 00000000 00000000 & 11111111 => 00000000 00000000 00000000
+        ftp_pkt.payload[5] = ((bytesSent >> 24) & 0xFF); // bytesSent >> 24 => ... => 00000000 00000000 00000000 00000000
+
+        int copyLen = qMin(chunk.size(), 239 - 6);
+        memcpy(&ftp_pkt.payload[6], chunk.constData(), copyLen);
+
+        mavlink_msg_file_transfer_protocol_encode(1, 1, &message, &ftp_pkt);
+
+        uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
+        uint16_t len = mavlink_msg_to_send_buffer(buffer, &message);
+
+        PendingChunk& pending = pendingChunks[quint32(bytesSent)];
+        pending.packet = QByteArray(reinterpret_cast<char*>(buffer), len);
+        pending.size = copyLen;
+        sendChunk(quint32(bytesSent), linkIndex);
+        links[linkIndex].bytesCounter->inc(copyLen);
+
+        qDebug() << "WriteFile chunk sent, offset:" << bytesSent << "size:" << copyLen << "link:" << linkIndex;
+
+        bytesSent += copyLen;
+    }
+
+    if (file.atEnd() && pendingChunks.isEmpty()) {
+        chunkTimer.stop();
         // send TerminateSession
         sendTerminateSession();
+    }
+}
+
+void MavlinkFileSender::sendChunk(quint32 offset, int linkIndex)
+{
+    PendingChunk& pending = pendingChunks[offset];
+    Link& link = links[linkIndex];
+    pending.link = linkIndex;
+    pending.sentAt.start();
+    ++link.inFlight;
+    udpSocket->writeDatagram(pending.packet, link.address, link.port);
+}
+
+// Lost or NAKed chunk: charge the loss to its link and fail over to the healthiest one
+void MavlinkFileSender::retransmitChunk(quint32 offset)
+{
+    auto it = pendingChunks.find(offset);
+    if (it == pendingChunks.end()) return;
+
+    Link& lossyLink = links[it->link];
+    --lossyLink.inFlight;
+    updateLinkLoss(lossyLink, true);
+    lossyLink.retransmitCounter->inc();
+
+    if (++it->retries > maxRetries) {
+        finishTransfer(false, "No ACK received. Giving up.");
         return;
     }
 
-    QByteArray chunk = file.read(chunkSize);
+    int target = bestLink();
+    qDebug() << "Chunk" << offset << "retry" << it->retries << "on link" << target;
+    sendChunk(offset, target);
+}
+
+void MavlinkFileSender::onChunkTimer()
+{
+    QList<quint32> expired;
+    for (auto it = pendingChunks.constBegin(); it != pendingChunks.constEnd(); ++it) {
+        double timeoutMs = qMax(300.0, 3 * links[it->link].srttMs);
+        if (it->sentAt.elapsed() > timeoutMs)
+            expired << it.key();
+    }
+
+    for (quint32 offset : expired) {
+        retransmitChunk(offset);
+        if (pendingChunks.isEmpty()) return; // gave up
+    }
+}
+
+// ACK and NAK of WriteFile echo the chunk offset at [2..5]
+void MavlinkFileSender::handleWriteAck(const mavlink_file_transfer_protocol_t &ftp)
+{
+    auto it = pendingChunks.end();
+    if (receiverEchoesRequest) {
+        quint32 offset = ftp.payload[2] | (ftp.payload[3] << 8) | (ftp.payload[4] << 16) | (quint32(ftp.payload[5]) << 24);
+        it = pendingChunks.find(offset);
+        if (it == pendingChunks.end())
+            return; // duplicate ACK of a retransmitted chunk
+    } else {
+        // Receiver without echo: the offset may belong to a late ACK of an earlier request
+        // (a retransmitted CreateFile also answers offset 0), so it is not trusted.
+        // Only the single chunk in flight is credited, once no such ACK can still arrive.
+        if (consumePossibleDuplicateAck() || pendingChunks.size() != 1)
+            return;
+        it = pendingChunks.begin();
+        possibleDuplicateAcks += it->retries;
+    }
 
+    Link& link = links[it->link];
+    --link.inFlight;
+    // RTT of retransmitted requests is ambiguous, only sample clean ones
+    if (it->retries == 0)
+        updateLinkRtt(link, it->sentAt.nsecsElapsed() / 1e6);
+    updateLinkLoss(link, false);
+    pendingChunks.erase(it);
+
+    fillChunkWindow();
+}
+
+void MavlinkFileSender::sendTerminateSession()
+{
     mavlink_message_t message{};
     mavlink_file_transfer_protocol_t ftp_pkt{};
     memset(&ftp_pkt, 0, sizeof(ftp_pkt));
@@ -87,35 +388,26 @@ void MavlinkFileSender::sendNextChunk()
     ftp_pkt.target_system = 1;
     ftp_pkt.target_component = 1;
 
-    ftp_pkt.payload[0] = 7; // OpCode WriteFile
+    ftp_pkt.payload[0] = 1; // OpCode TerminateSession
     ftp_pkt.payload[1] = session;
 
-    // write 4-byte offset (little-endian)
-    ftp_pkt.payload[2] = (bytesSent & 0xFF);         // bytesSent(0) & 11111111(0xFF) = 00000000
-    ftp_pkt.payload[3] = ((bytesSent >> 8) & 0xFF);  // bytesSent >> 8 => 00000000 00000000 & 11111111 => 00000000 00000000
-    ftp_pkt.payload[4] = ((bytesSent >> 16) & 0xFF); // bytesSent >> 16 => 00000000 00000000 00000000 & 11111111 => 00000000 00000000 00000000
-    ftp_pkt.payload[5] = ((bytesSent >> 24) & 0xFF); // bytesSent >> 24 => ... => 00000000 00000000 00000000 00000000
-
-    int copyLen = qMin(chunk.size(), 239 - 6);
-    memcpy(&ftp_pkt.payload[6], chunk.constData(), copyLen);
-
     mavlink_msg_file_transfer_protocol_encode(1, 1, &message, &ftp_pkt);
 
     uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
     uint16_t len = mavlink_msg_to_send_buffer(buffer, &message);
 
-    lastSentPacket = QByteArray(reinterpret_cast<char*>(buffer), len);
-    lastOpcodeSent = 7;
-    udpSocket->writeDatagram(lastSentPacket, QHostAddress(targetIp), targetPort);
-
-    ackTimeoutTimer.start(300);
+    sendControlPacket(QByteArray(reinterpret_cast<char*>(buffer), len), 1);
 
-    qDebug() << "WriteFile chunk sent, offset:" << bytesSent << "size:" << copyLen;
+    qDebug() << "TerminateSession sent";
+}
 
-    bytesSent += copyLen;
+// Sends a request with offset at [2..5] and data at [6..]
+void MavlinkFileSender::sendFtpRequest(uint8_t opcode, quint32 offset, const QByteArray &data)
+{
+    sendControlPacket(buildFtpRequest(opcode, offset, data), opcode);
 }
 
-void MavlinkFileSender::sendTerminateSession()
+QByteArray MavlinkFileSender::buildFtpRequest(uint8_t opcode, quint32 offset, const QByteArray &data) const
 {
     mavlink_message_t message{};
     mavlink_file_transfer_protocol_t ftp_pkt{};
@@ -125,21 +417,299 @@ void MavlinkFileSender::sendTerminateSession()
     ftp_pkt.target_system = 1;
     ftp_pkt.target_component = 1;
 
-    ftp_pkt.payload[0] = 1; // OpCode TerminateSession
+    ftp_pkt.payload[0] = opcode;
     ftp_pkt.payload[1] = session;
+    ftp_pkt.payload[2] = (offset & 0xFF);
+    ftp_pkt.payload[3] = ((offset >> 8) & 0xFF);
+    ftp_pkt.payload[4] = ((offset >> 16) & 0xFF);
+    ftp_pkt.payload[5] = ((offset >> 24) & 0xFF);
+
+    int copyLen = qMin(data.size(), 239 - 6);
+    memcpy(&ftp_pkt.payload[6], data.constData(), copyLen);
 
     mavlink_msg_file_transfer_protocol_encode(1, 1, &message, &ftp_pkt);
 
     uint8_t buffer[MAVLINK_MAX_PACKET_LEN];
     uint16_t len = mavlink_msg_to_send_buffer(buffer, &message);
+    return QByteArray(reinterpret_cast<char*>(buffer), len);
+}
 
-    lastSentPacket = QByteArray(reinterpret_cast<char*>(buffer), len);
-    lastOpcodeSent = 1;
-    udpSocket->writeDatagram(lastSentPacket, QHostAddress(targetIp), targetPort);
+// Non-WriteFile requests are stop-and-wait on the currently best link
+void MavlinkFileSender::sendControlPacket(const QByteArray &packet, uint8_t opcode)
+{
+    lastSentPacket = packet;
+    lastOpcodeSent = opcode;
+    controlLink = bestLink();
+    udpSocket->writeDatagram(lastSentPacket, links[controlLink].address, links[controlLink].port);
+    rttTimer.start();
 
     ackTimeoutTimer.start(300);
+}
 
-    qDebug() << "TerminateSession sent";
+void MavlinkFileSender::sendListDirectory()
+{
+    sendFtpRequest(3, listOffset, listQueue.first().toUtf8()); // OpCode ListDirectory
+    qDebug() << "ListDirectory sent for" << listQueue.first() << "offset:" << listOffset;
+}
+
+void MavlinkFileSender::sendCreateDirectory()
+{
+    sendFtpRequest(9, 0, mkdirQueue.first().toUtf8()); // OpCode CreateDirectory
+    qDebug() << "CreateDirectory sent for" << mkdirQueue.first();
+}
+
+void MavlinkFileSender::sendCalcFileCrc()
+{
+    sendFtpRequest(14, 0, crcQueue.first().remotePath.toUtf8()); // OpCode CalcFileCRC32
+    qDebug() << "CalcFileCRC32 sent for" << crcQueue.first().remotePath;
+}
+
+// Collects "F<name>\t<size>" / "D<name>" entries and requests the next page
+void MavlinkFileSender::handleListDirectoryAck(const QByteArray &data)
+{
+    const QString dir = listQueue.first();
+    remoteDirs.insert(dir);
+
+    quint32 entries = 0;
+    for (const QByteArray& entry : data.split('\0')) {
+        if (entry.isEmpty())
+            break;
+        ++entries;
+        if (entry.at(0) == 'F') {
+            QList<QByteArray> parts = entry.mid(1).split('\t');
+            remoteFiles.insert(dir + "/" + QString::fromUtf8(parts.value(0)), parts.value(1).toLongLong());
+        }
+    }
+
+    if (entries == 0) {
+        finishListingDirectory();
+        return;
+    }
+
+    listOffset += entries;
+    sendListDirectory();
+}
+
+void MavlinkFileSender::finishListingDirectory()
+{
+    listQueue.removeFirst();
+    listOffset = 0;
+    if (!listQueue.isEmpty())
+        sendListDirectory();
+    else
+        planSync();
+}
+
+// Missing or resized files are uploaded, same-size files are CRC-checked first
+void MavlinkFileSender::planSync()
+{
+    for (const QString& dir : std::as_const(syncRemoteDirs)) {
+        if (!remoteDirs.contains(dir))
+            mkdirQueue << dir;
+    }
+
+    for (const SyncEntry& entry : std::as_const(localEntries)) {
+        auto it = remoteFiles.constFind(entry.remotePath);
+        if (it == remoteFiles.constEnd() || it.value() != entry.size)
+            uploadQueue.append(entry);
+        else
+            crcQueue.append(entry);
+    }
+
+    qDebug() << "Sync plan: dirs to create" << mkdirQueue.size()
+             << "files to upload" << uploadQueue.size()
+             << "files to verify" << crcQueue.size();
+
+    computeLocalCrcs();
+    advanceSync();
+}
+
+// Local side of the CRC checks is read off the GUI thread, results come back queued
+void MavlinkFileSender::computeLocalCrcs()
+{
+    localCrcsReady = crcQueue.isEmpty();
+    if (localCrcsReady)
+        return;
+
+    QStringList paths;
+    for (const SyncEntry& entry : std::as_const(crcQueue))
+        paths << entry.localPath;
+
+    const int generation = syncGeneration;
+    QtConcurrent::run([=]() {
+        QHash<QString, quint32> crcs;
+        for (const QString& path : paths)
+            crcs.insert(path, crc32ForFile(path));
+        QMetaObject::invokeMethod(this, [=]() {
+            if (generation != syncGeneration || !syncMode)
+                return; // sync finished or restarted meanwhile
+            localCrcs = crcs;
+            localCrcsReady = true;
+            const QVector<QPair<SyncEntry, quint32>> waiting = remoteCrcs;
+            remoteCrcs.clear();
+            for (const auto& result : waiting)
+                compareCrc(result.first, result.second);
+            if (isSyncIdle())
+                advanceSync();
+        }, Qt::QueuedConnection);
+    });
+}
+
+// Changed files join the upload queue, compared as soon as both sides are known
+void MavlinkFileSender::compareCrc(const SyncEntry &entry, quint32 remoteCrc)
+{
+    if (!localCrcsReady) {
+        remoteCrcs.append({entry, remoteCrc});
+        return;
+    }
+    if (remoteCrc != localCrcs.value(entry.localPath))
+        uploadQueue.append(entry);
+}
+
+// No control request or upload in progress
+bool MavlinkFileSender::isSyncIdle() const
+{
+    return syncMode && !ackTimeoutTimer.isActive() && !file.isOpen();
+}
+
+// CalcFileCRC32 requests tagged with their offset field, answered out of band of the control channel
+void MavlinkFileSender::fillCrcWindow()
+{
+    while (pendingCrcs.size() < maxCrcInFlight && !crcQueue.isEmpty()) {
+        quint32 tag = nextCrcTag++;
+        PendingCrc& pending = pendingCrcs[tag];
+        pending.entry = crcQueue.takeFirst();
+        pending.packet = buildFtpRequest(14, tag, pending.entry.remotePath.toUtf8()); // OpCode CalcFileCRC32
+        sendCrcRequest(tag, bestLink());
+        qDebug() << "CalcFileCRC32 sent for" << pending.entry.remotePath << "tag:" << tag;
+    }
+    if (!pendingCrcs.isEmpty() && !crcTimer.isActive())
+        crcTimer.start(50);
+}
+
+void MavlinkFileSender::sendCrcRequest(quint32 tag, int linkIndex)
+{
+    PendingCrc& pending = pendingCrcs[tag];
+    pending.link = linkIndex;
+    pending.sentAt.start();
+    udpSocket->writeDatagram(pending.packet, links[linkIndex].address, links[linkIndex].port);
+}
+
+void MavlinkFileSender::onCrcTimer()
+{
+    QList<quint32> expired;
+    for (auto it = pendingCrcs.constBegin(); it != pendingCrcs.constEnd(); ++it) {
+        double timeoutMs = qMax(300.0, 3 * links[it->link].srttMs);
+        if (it->sentAt.elapsed() > timeoutMs)
+            expired << it.key();
+    }
+
+    for (quint32 tag : expired) {
+        PendingCrc& pending = pendingCrcs[tag];
+        Link& lossyLink = links[pending.link];
+        updateLinkLoss(lossyLink, true);
+        lossyLink.retransmitCounter->inc();
+        if (++pending.retries > maxRetries) {
+            // Cannot verify, upload it
+            qDebug() << "No CRC from board, uploading" << pending.entry.remotePath;
+            uploadQueue.append(pending.entry);
+            pendingCrcs.remove(tag);
+            continue;
+        }
+        sendCrcRequest(tag, bestLink());
+    }
+    if (!expired.isEmpty())
+        finishCrcResponse();
+}
+
+// ACK carries the board CRC at [7..10], NAK means the file cannot be verified
+void MavlinkFileSender::handleCrcResponse(const mavlink_file_transfer_protocol_t &ftp)
+{
+    quint32 tag = ftp.payload[2] | (ftp.payload[3] << 8) | (ftp.payload[4] << 16) | (quint32(ftp.payload[5]) << 24);
+    auto it = pendingCrcs.find(tag);
+    if (it == pendingCrcs.end())
+        return; // duplicate of a retransmitted request
+
+    Link& link = links[it->link];
+    if (ftp.payload[0] == 128) {
+        if (it->retries == 0)
+            updateLinkRtt(link, it->sentAt.nsecsElapsed() / 1e6);
+        updateLinkLoss(link, false);
+        quint32 remoteCrc = ftp.payload[7] | (ftp.payload[8] << 8) | (ftp.payload[9] << 16) | (quint32(ftp.payload[10]) << 24);
+        compareCrc(it->entry, remoteCrc);
+    } else {
+        link.nakCounter->inc();
+        uploadQueue.append(it->entry);
+    }
+    pendingCrcs.erase(it);
+    finishCrcResponse();
+}
+
+// Refills the CRC window and picks up new uploads if the control channel is idle
+void MavlinkFileSender::finishCrcResponse()
+{
+    fillCrcWindow();
+    if (pendingCrcs.isEmpty())
+        crcTimer.stop();
+    if (isSyncIdle())
+        advanceSync();
+}
+
+// Control channel does one thing at a time: mkdir, CRC checks (receiver without echo), uploads.
+// A receiver that echoes the request opcode runs the CRC checks next to it in a window.
+void MavlinkFileSender::advanceSync()
+{
+    if (receiverEchoesRequest)
+        fillCrcWindow();
+
+    if (!mkdirQueue.isEmpty()) {
+        sendCreateDirectory();
+    } else if (!receiverEchoesRequest && !crcQueue.isEmpty()) {
+        sendCalcFileCrc();
+    } else if (!uploadQueue.isEmpty()) {
+        startNextUpload();
+    } else if (crcQueue.isEmpty() && pendingCrcs.isEmpty() && remoteCrcs.isEmpty()) {
+        finishTransfer(true, QString("Directory synced: %1 uploaded, %2 up to date.")
+                                 .arg(filesUploaded).arg(localEntries.size() - filesUploaded));
+    }
+    // otherwise CRC checks are still running, their results call advanceSync() again
+}
+
+// Opens next queued file and starts its CreateFile right after the previous one ended
+void MavlinkFileSender::startNextUpload()
+{
+    const SyncEntry& entry = uploadQueue.first();
+    file.setFileName(entry.localPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        finishTransfer(false, "Cannot open file: " + entry.localPath);
+        return;
+    }
+
+    currentRemotePath = entry.remotePath;
+    bytesSent = 0;
+    sendCreateFile();
+}
+
+void MavlinkFileSender::finishTransfer(bool success, const QString &message)
+{
+    ackTimeoutTimer.stop();
+    chunkTimer.stop();
+    crcTimer.stop();
+    pendingChunks.clear();
+    pendingCrcs.clear();
+    remoteCrcs.clear();
+    ++syncGeneration;
+    for (Link& link : links)
+        link.inFlight = 0;
+    if (file.isOpen())
+        file.close();
+
+    if (syncMode) {
+        syncMode = false;
+        emit syncFinished(success, message);
+    } else {
+        emit fileSent(success, message);
+    }
 }
 
 void MavlinkFileSender::onSocketReadyRead()
@@ -159,10 +729,15 @@ void MavlinkFileSender::onSocketReadyRead()
                     mavlink_msg_file_transfer_protocol_decode(&msg, &ftp);
 
                     uint8_t opcode = ftp.payload[0];
-                    if (opcode == 128) { // ACK
-                        handleAck();
+                    if ((opcode == 128 || opcode == 129) && !pendingCrcs.isEmpty()
+                        && ftp.payload[1] == session && ftp.payload[6] == 14) {
+                        handleCrcResponse(ftp);
+                    } else if ((opcode == 128 || opcode == 129) && !isResponseForCurrentRequest(ftp)) {
+                        qDebug() << "Stale response dropped, request opcode" << ftp.payload[6];
+                    } else if (opcode == 128) { // ACK
+                        handleAck(ftp);
                     } else if (opcode == 129) { // NAK
-                        handleNak();
+                        handleNak(ftp);
                     }
                 }
             }
@@ -170,13 +745,36 @@ void MavlinkFileSender::onSocketReadyRead()
     }
 }
 
+// Receiver without echo: every extra transmission of an acknowledged request may still
+// produce one ACK; such ACKs are dropped instead of being credited to the next request
+bool MavlinkFileSender::consumePossibleDuplicateAck()
+{
+    if (possibleDuplicateAcks == 0)
+        return false;
+    --possibleDuplicateAcks;
+    qDebug() << "Ambiguous ACK dropped, possible duplicates left:" << possibleDuplicateAcks;
+    return true;
+}
+
+// Responses: [0] ACK/NAK, [1] session, [2..5] offset, [6] request opcode, [7..] data.
+// A receiver that leaves [6] at 0 does not echo the request and is matched by state only.
+bool MavlinkFileSender::isResponseForCurrentRequest(const mavlink_file_transfer_protocol_t &ftp)
+{
+    if (ftp.payload[1] != session)
+        return false;
+
+    uint8_t requestOpcode = ftp.payload[6];
+    if (requestOpcode == 0)
+        return true;
+
+    receiverEchoesRequest = true;
+    return requestOpcode == lastOpcodeSent;
+}
 
 void MavlinkFileSender::onAckTimeout()
 {
     if (++retryCount > maxRetries) {
-        emit fileSent(false, "No ACK received. Giving up.");
-        file.close();
-        ackTimeoutTimer.stop();
+        finishTransfer(false, "No ACK received. Giving up.");
         return;
     }
 
@@ -184,32 +782,111 @@ void MavlinkFileSender::onAckTimeout()
     resendLastPacket();
 }
 
+// Charges the loss to the link that carried the request and fails over to the healthiest one
 void MavlinkFileSender::resendLastPacket()
 {
-    udpSocket->writeDatagram(lastSentPacket, QHostAddress(targetIp), targetPort);
+    links[controlLink].retransmitCounter->inc();
+    updateLinkLoss(links[controlLink], true);
+    controlLink = bestLink();
+    udpSocket->writeDatagram(lastSentPacket, links[controlLink].address, links[controlLink].port);
     ackTimeoutTimer.start(300);
 }
 
-void MavlinkFileSender::handleAck()
+void MavlinkFileSender::handleAck(const mavlink_file_transfer_protocol_t& ftp)
 {
+    if (lastOpcodeSent == 7) {
+        handleWriteAck(ftp);
+        return;
+    }
+
+    if (!receiverEchoesRequest) {
+        if (consumePossibleDuplicateAck())
+            return; // may belong to an earlier request, a real ACK is recovered by the retry
+        possibleDuplicateAcks += retryCount;
+    }
+
     ackTimeoutTimer.stop();
+    // RTT of retransmitted requests is ambiguous, only sample clean ones
+    if (retryCount == 0)
+        updateLinkRtt(links[controlLink], rttTimer.nsecsElapsed() / 1e6);
+    updateLinkLoss(links[controlLink], false);
     retryCount = 0;
 
-    if (lastOpcodeSent == 6) {
+    if (lastOpcodeSent == 3) {
+        handleListDirectoryAck(QByteArray(reinterpret_cast<const char*>(&ftp.payload[7]), 239 - 7));
+    } else if (lastOpcodeSent == 9) {
+        qDebug() << "ACK for CreateDirectory.\n";
+        mkdirQueue.removeFirst();
+        advanceSync();
+    } else if (lastOpcodeSent == 14) {
+        quint32 remoteCrc = ftp.payload[7] | (ftp.payload[8] << 8) | (ftp.payload[9] << 16) | (quint32(ftp.payload[10]) << 24);
+        compareCrc(crcQueue.takeFirst(), remoteCrc);
+        advanceSync();
+    } else if (lastOpcodeSent == 6) {
         qDebug() << "ACK for CreateFile received.\n";
-        sendNextChunk();
-    } else if (lastOpcodeSent == 7) {
-        qDebug() << "ACK for WriteFile chunk.\n";
-        sendNextChunk();
+        lastOpcodeSent = 7;
+        chunkTimer.start(50);
+        fillChunkWindow();
     } else if (lastOpcodeSent == 1) {
         qDebug() << "ACK for TerminateSession. Transfer complete.\n";
         file.close();
-        emit fileSent(true, "File sent successfully.");
+        if (transferTimer.elapsed() > 0)
+            throughputGauge->set(bytesSent * 1000 / transferTimer.elapsed());
+        if (syncMode) {
+            uploadQueue.removeFirst();
+            ++filesUploaded;
+            advanceSync();
+        } else {
+            emit fileSent(true, "File sent successfully.");
+        }
     }
 }
 
-void MavlinkFileSender::handleNak()
+void MavlinkFileSender::handleNak(const mavlink_file_transfer_protocol_t& ftp)
 {
+    const uint8_t error = ftp.payload[7];
+
+    if (lastOpcodeSent == 7) {
+        quint32 offset = ftp.payload[2] | (ftp.payload[3] << 8) | (ftp.payload[4] << 16) | (quint32(ftp.payload[5]) << 24);
+        auto it = pendingChunks.constFind(offset);
+        if (it != pendingChunks.constEnd()) {
+            links[it->link].nakCounter->inc();
+            qDebug() << "NAK for chunk" << offset << ". Retrying.";
+            retransmitChunk(offset);
+        }
+        return;
+    }
+
+    links[controlLink].nakCounter->inc();
+
+    if (syncMode) {
+        // ListDirectory: EOF ends the listing, FileNotFound means the dir must be created
+        if (lastOpcodeSent == 3 && (error == 6 || error == 10)) {
+            ackTimeoutTimer.stop();
+            retryCount = 0;
+            if (error == 6)
+                remoteDirs.insert(listQueue.first());
+            finishListingDirectory();
+            return;
+        }
+        // CreateDirectory: FileExists is fine
+        if (lastOpcodeSent == 9 && error == 8) {
+            ackTimeoutTimer.stop();
+            retryCount = 0;
+            mkdirQueue.removeFirst();
+            advanceSync();
+            return;
+        }
+        // CalcFileCRC32: cannot verify, upload it
+        if (lastOpcodeSent == 14) {
+            ackTimeoutTimer.stop();
+            retryCount = 0;
+            uploadQueue.append(crcQueue.takeFirst());
+            advanceSync();
+            return;
+        }
+    }
+
     qDebug() << "NAK received. Retrying.";
     onAckTimeout();
 }
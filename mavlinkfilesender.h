@@ -6,11 +6,21 @@
 #include <QHostAddress>
 #include <QFile>
 #include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
 #include <QDebug>
 #include <QTimer>
 #include <QtGlobal>
+#include <algorithm>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QtConcurrent>
 #include "mavlink.h"
+#include "metrics.h"
 
 class MavlinkFileSender : public QObject
 {
@@ -19,29 +29,106 @@ public:
     explicit MavlinkFileSender(QObject *parent = nullptr);
 
     void setTarget(const QString& ip, quint16 port);
+    void addLink(const QString& ip, quint16 port); // extra UDP endpoint of the same vehicle, WriteFile chunks are striped over all links
     void sendFile(const QString& localFilePath);
+    void syncDirectory(const QString& localDirPath, const QString& remoteDirPath);
 
 signals:
     void fileSent(bool success, const QString& message);
+    void syncFinished(bool success, const QString& message);
 
 private slots:
     void onSocketReadyRead();
     void onAckTimeout();
+    void onChunkTimer();
+    void onCrcTimer();
 
 private:
+    struct SyncEntry {
+        QString localPath;
+        QString remotePath;
+        qint64 size = 0;
+    };
+
+    struct Link {
+        QHostAddress address;
+        quint16 port = 0;
+        double srttMs = 100;    // smoothed RTT
+        double loss = 0;        // EWMA of lost requests
+        int inFlight = 0;
+        MetricsRegistry::Histogram* rttHistogram = nullptr;
+        MetricsRegistry::Counter* retransmitCounter = nullptr;
+        MetricsRegistry::Counter* nakCounter = nullptr;
+        MetricsRegistry::Counter* bytesCounter = nullptr;
+        MetricsRegistry::Gauge* srttGauge = nullptr;
+        MetricsRegistry::Gauge* lossGauge = nullptr;
+    };
+
+    struct PendingCrc {
+        SyncEntry entry;
+        QByteArray packet;
+        int link = 0;
+        int retries = 0;
+        QElapsedTimer sentAt;
+    };
+
+    struct PendingChunk {
+        QByteArray packet;
+        int size = 0;
+        int link = 0;
+        int retries = 0;
+        QElapsedTimer sentAt;
+    };
+
     void sendCreateFile();
-    void sendNextChunk();
     void sendTerminateSession();
+    void sendFtpRequest(uint8_t opcode, quint32 offset, const QByteArray& data);
+    QByteArray buildFtpRequest(uint8_t opcode, quint32 offset, const QByteArray& data) const;
+    void sendControlPacket(const QByteArray& packet, uint8_t opcode);
+
+    // Striped WriteFile
+    void fillChunkWindow();
+    void sendChunk(quint32 offset, int linkIndex);
+    void retransmitChunk(quint32 offset);
+    void handleWriteAck(const mavlink_file_transfer_protocol_t& ftp);
+    double linkCost(const Link& link) const;
+    int bestLink() const;
+    int pickLinkForChunk() const;
+    void updateLinkRtt(Link& link, double rttMs);
+    void updateLinkLoss(Link& link, bool lost);
 
-    void handleAck();
-    void handleNak();
+    void sendListDirectory();
+    void sendCreateDirectory();
+    void sendCalcFileCrc();
+    void handleListDirectoryAck(const QByteArray& data);
+    void finishListingDirectory();
+    void planSync();
+    void computeLocalCrcs();
+    void compareCrc(const SyncEntry& entry, quint32 remoteCrc);
+    bool isSyncIdle() const;
+    void fillCrcWindow();
+    void sendCrcRequest(quint32 tag, int linkIndex);
+    void handleCrcResponse(const mavlink_file_transfer_protocol_t& ftp);
+    void finishCrcResponse();
+    void advanceSync();
+    void startNextUpload();
+    void finishTransfer(bool success, const QString& message);
+
+    void bindLinkMetrics(Link& link);
+    void bindThroughputMetric();
+
+    bool consumePossibleDuplicateAck();
+    bool isResponseForCurrentRequest(const mavlink_file_transfer_protocol_t& ftp);
+    void handleAck(const mavlink_file_transfer_protocol_t& ftp);
+    void handleNak(const mavlink_file_transfer_protocol_t& ftp);
     void resendLastPacket();
 
     QUdpSocket* udpSocket = nullptr;
-    QString targetIp;
-    quint16 targetPort; //14550
+    QVector<Link> links;     // first one is set by setTarget(), e.g. port 14550
+    int controlLink = 0;     // link used for the current non-WriteFile request
 
     QFile file;
+    QString currentRemotePath;
     quint8 session = 0;
     qint64 bytesSent = 0;
     const qint64 chunkSize = 128;
@@ -51,6 +138,38 @@ private:
     uint8_t lastOpcodeSent = 0;
     const int maxRetries = 5;
     int retryCount = 0;
+    bool receiverEchoesRequest = false;   // set once a response carries the request opcode
+    int possibleDuplicateAcks = 0;        // ACKs that retransmitted requests may still produce
+
+    QMap<quint32, PendingChunk> pendingChunks; // WriteFile chunks in flight by offset
+    QTimer chunkTimer;
+    const int maxInFlightPerLink = 1;          // stop-and-wait per link, links run in parallel
+
+    QElapsedTimer rttTimer;
+    QElapsedTimer transferTimer;
+    MetricsRegistry::Gauge* throughputGauge = nullptr;
+
+    // Directory sync state
+    bool syncMode = false;
+    QString syncRemoteRoot;
+    QStringList syncRemoteDirs;       // remote counterparts of local dirs, parents first
+    QVector<SyncEntry> localEntries;
+    QStringList listQueue;            // remote dirs still to be listed
+    quint32 listOffset = 0;
+    QSet<QString> remoteDirs;
+    QHash<QString, qint64> remoteFiles;
+    QStringList mkdirQueue;
+    QVector<SyncEntry> crcQueue;       // same-size files whose board CRC was not requested yet
+    QMap<quint32, PendingCrc> pendingCrcs; // CRC requests in flight by tag (offset field)
+    quint32 nextCrcTag = 0;
+    QTimer crcTimer;
+    const int maxCrcInFlight = 4;
+    QHash<QString, quint32> localCrcs;    // by local path, computed on a worker thread
+    bool localCrcsReady = false;
+    QVector<QPair<SyncEntry, quint32>> remoteCrcs; // board CRCs waiting for the local ones
+    int syncGeneration = 0;
+    QVector<SyncEntry> uploadQueue;
+    int filesUploaded = 0;
 };
 
 #endif // MAVLINKFILESENDER_H
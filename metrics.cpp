@@ -0,0 +1,158 @@
+#include "metrics.h"
+
+MetricsRegistry::Histogram::Histogram(const QVector<double>& upperBounds)
+    : bounds(upperBounds),
+    bucketCounts(new std::atomic<quint64>[upperBounds.size()])
+{
+    for (int i = 0; i < bounds.size(); ++i)
+        bucketCounts[i].store(0, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::Histogram::observe(double seconds)
+{
+    for (int i = 0; i < bounds.size(); ++i) {
+        if (seconds <= bounds[i]) {
+            bucketCounts[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumMicros.fetch_add(quint64(seconds * 1e6), std::memory_order_relaxed);
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Counter* MetricsRegistry::counter(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&mutex);
+    Family& family = families[name];
+    family.help = help;
+    family.type = "counter";
+    auto& metric = family.counters[labels];
+    if (!metric)
+        metric = std::make_shared<Counter>();
+    return metric.get();
+}
+
+MetricsRegistry::Gauge* MetricsRegistry::gauge(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&mutex);
+    Family& family = families[name];
+    family.help = help;
+    family.type = "gauge";
+    auto& metric = family.gauges[labels];
+    if (!metric)
+        metric = std::make_shared<Gauge>();
+    return metric.get();
+}
+
+MetricsRegistry::Histogram* MetricsRegistry::histogram(const QString &name, const QString &help, const QString &labels,
+                                                       const QVector<double> &upperBounds)
+{
+    QMutexLocker locker(&mutex);
+    Family& family = families[name];
+    family.help = help;
+    family.type = "histogram";
+    auto& metric = family.histograms[labels];
+    if (!metric)
+        metric = std::make_shared<Histogram>(upperBounds);
+    return metric.get();
+}
+
+// Renders all metrics; bucket counts are stored per bucket and made cumulative here
+QByteArray MetricsRegistry::exposition() const
+{
+    QMutexLocker locker(&mutex);
+    QString out;
+    auto series = [](const QString& name, const QString& labels) {
+        return labels.isEmpty() ? name : QString("%1{%2}").arg(name, labels);
+    };
+
+    for (auto it = families.constBegin(); it != families.constEnd(); ++it) {
+        const QString& name = it.key();
+        const Family& family = it.value();
+        out += QString("# HELP %1 %2\n# TYPE %1 %3\n").arg(name, family.help, family.type);
+
+        for (auto c = family.counters.constBegin(); c != family.counters.constEnd(); ++c)
+            out += QString("%1 %2\n").arg(series(name, c.key())).arg(c.value()->value.load(std::memory_order_relaxed));
+
+        for (auto g = family.gauges.constBegin(); g != family.gauges.constEnd(); ++g)
+            out += QString("%1 %2\n").arg(series(name, g.key())).arg(g.value()->value.load(std::memory_order_relaxed));
+
+        for (auto h = family.histograms.constBegin(); h != family.histograms.constEnd(); ++h) {
+            const Histogram& histogram = *h.value();
+            QString prefix = h.key().isEmpty() ? QString() : h.key() + ",";
+            quint64 cumulative = 0;
+            for (int i = 0; i < histogram.bounds.size(); ++i) {
+                cumulative += histogram.bucketCounts[i].load(std::memory_order_relaxed);
+                out += QString("%1_bucket{%2le=\"%3\"} %4\n").arg(name, prefix).arg(histogram.bounds[i]).arg(cumulative);
+            }
+            quint64 count = histogram.count.load(std::memory_order_relaxed);
+            out += QString("%1_bucket{%2le=\"+Inf\"} %3\n").arg(name, prefix).arg(count);
+            out += QString("%1 %2\n").arg(series(name + "_sum", h.key()))
+                       .arg(histogram.sumMicros.load(std::memory_order_relaxed) / 1e6);
+            out += QString("%1 %2\n").arg(series(name + "_count", h.key())).arg(count);
+        }
+    }
+    return out.toUtf8();
+}
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QObject(parent)
+{
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::start(quint16 port)
+{
+    if (!server->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Metrics endpoint failed to listen on port" << port << server->errorString();
+        return false;
+    }
+    qDebug() << "Metrics endpoint: http://127.0.0.1:" << port << "/metrics";
+    return true;
+}
+
+// Buffers each request until the end of its headers and answers it exactly once
+void MetricsServer::onNewConnection()
+{
+    while (server->hasPendingConnections()) {
+        QTcpSocket* socket = server->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        QTimer::singleShot(5000, socket, [socket]() {
+            if (!socket->property("answered").toBool())
+                socket->abort(); // client never finished its request
+        });
+        connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+            bool complete = request.contains("\r\n\r\n");
+            if (!complete && request.size() < 8192) {
+                socket->setProperty("request", request);
+                return;
+            }
+            // Anything sent after the headers is ignored
+            QObject::disconnect(socket, &QTcpSocket::readyRead, socket, nullptr);
+            socket->setProperty("answered", true);
+            socket->setProperty("request", QVariant());
+
+            bool isMetrics = complete && request.startsWith("GET /metrics");
+            QByteArray body = isMetrics ? MetricsRegistry::instance().exposition()
+                                        : QByteArray(complete ? "Not Found\n" : "Bad Request\n");
+
+            QByteArray response = isMetrics ? "HTTP/1.1 200 OK\r\n"
+                                            : (complete ? "HTTP/1.1 404 Not Found\r\n" : "HTTP/1.1 400 Bad Request\r\n");
+            response += "Content-Type: text/plain; version=0.0.4\r\n";
+            response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+            response += "Connection: close\r\n\r\n";
+            response += body;
+
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+}
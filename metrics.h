@@ -0,0 +1,82 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QMap>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QDebug>
+#include <atomic>
+#include <memory>
+
+// Metric instances are created once (under a mutex) and then updated lock-free,
+// so hot paths should keep the returned pointer instead of looking it up again
+class MetricsRegistry
+{
+public:
+    struct Counter {
+        std::atomic<quint64> value{0};
+        void inc(quint64 n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    };
+
+    struct Gauge {
+        std::atomic<qint64> value{0};
+        void set(qint64 v) { value.store(v, std::memory_order_relaxed); }
+    };
+
+    struct Histogram {
+        explicit Histogram(const QVector<double>& upperBounds);
+        void observe(double seconds);
+
+        const QVector<double> bounds;
+        std::unique_ptr<std::atomic<quint64>[]> bucketCounts;
+        std::atomic<quint64> count{0};
+        std::atomic<quint64> sumMicros{0};
+    };
+
+    static MetricsRegistry& instance();
+
+    // labels in Prometheus form, e.g. device="192.168.144.75"
+    Counter* counter(const QString& name, const QString& help, const QString& labels = QString());
+    Gauge* gauge(const QString& name, const QString& help, const QString& labels = QString());
+    Histogram* histogram(const QString& name, const QString& help, const QString& labels,
+                         const QVector<double>& upperBounds);
+
+    QByteArray exposition() const;
+
+private:
+    MetricsRegistry() = default;
+
+    struct Family {
+        QString help;
+        QString type;
+        QMap<QString, std::shared_ptr<Counter>> counters;
+        QMap<QString, std::shared_ptr<Gauge>> gauges;
+        QMap<QString, std::shared_ptr<Histogram>> histograms;
+    };
+
+    mutable QMutex mutex;
+    QMap<QString, Family> families;
+};
+
+// Minimal HTTP endpoint serving GET /metrics in Prometheus text format
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+
+    bool start(quint16 port);
+
+private slots:
+    void onNewConnection();
+
+private:
+    QTcpServer* server = nullptr;
+};
+
+#endif // METRICS_H
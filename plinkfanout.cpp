@@ -0,0 +1,133 @@
+#include "plinkfanout.h"
+
+// Constructor: initializes all configuration parameters
+PlinkFanOut::PlinkFanOut(QObject *parent,
+                         const QString& user,
+                         const QString& password,
+                         const QString& plink,
+                         int maxParallel)
+    : QObject(parent),
+    remoteUser(user),
+    remotePassword(password),
+    plinkPath(plink),
+    maxParallel(maxParallel)
+{
+}
+
+// Queues a command for one board, starts it right away if a slot is free
+int PlinkFanOut::run(const QString& ip, const QString& command, int timeoutMs)
+{
+    Job job;
+    job.id = nextJobId++;
+    job.ip = ip;
+    job.command = command;
+    job.timeoutMs = timeoutMs;
+    pending.append(job);
+    startNext();
+    return job.id;
+}
+
+// Fills free slots, skipping boards that already have a job in progress
+void PlinkFanOut::startNext()
+{
+    for (int i = 0; i < pending.size() && running.size() < maxParallel; ) {
+        if (running.contains(pending[i].ip)) {
+            ++i;
+            continue;
+        }
+
+        Job job = pending.takeAt(i);
+        running.insert(job.ip, job);
+
+        if (hostKeys.contains(job.ip)) {
+            startProcess(job, hostKeys.value(job.ip));
+            continue;
+        }
+
+        QtConcurrent::run([=]() {
+            QString hostKey = FirmwareUpdater::fetchHostKey(plinkPath, remoteUser, remotePassword, job.ip);
+            QMetaObject::invokeMethod(this, [=]() {
+                if (hostKey.isEmpty()) {
+                    finishJob(job.ip, -1, "Failed to fetch host key!");
+                    return;
+                }
+                hostKeys.insert(job.ip, hostKey);
+                startProcess(job, hostKey);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void PlinkFanOut::startProcess(const Job& job, const QString& hostKey)
+{
+    const QString ip = job.ip;
+    const int jobId = job.id;
+    QStringList arguments = {
+        "-pw", remotePassword,
+        "-batch",
+        "-hostkey", hostKey,
+        QString("%1@%2").arg(remoteUser, ip),
+        job.command
+    };
+
+    QProcess* process = new QProcess(this);
+    running[ip].process = process;
+
+    connect(process, &QProcess::readyReadStandardOutput, this, [=]() {
+        emit outputReady(jobId, ip, process->readAllStandardOutput(), false);
+    });
+    connect(process, &QProcess::readyReadStandardError, this, [=]() {
+        emit outputReady(jobId, ip, process->readAllStandardError(), true);
+    });
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [=](int exitCode, QProcess::ExitStatus exitStatus) {
+                // Deliver whatever is still buffered before the job is reported as finished
+                QByteArray out = process->readAllStandardOutput();
+                if (!out.isEmpty())
+                    emit outputReady(jobId, ip, out, false);
+                QByteArray err = process->readAllStandardError();
+                if (!err.isEmpty())
+                    emit outputReady(jobId, ip, err, true);
+
+                if (process->property("timedOut").toBool())
+                    finishJob(ip, -1, "Timeout, command killed.");
+                else if (exitStatus != QProcess::NormalExit)
+                    finishJob(ip, -1, "plink crashed.");
+                else
+                    finishJob(ip, exitCode, QString());
+            });
+    connect(process, &QProcess::errorOccurred, this, [=](QProcess::ProcessError error) {
+        // Queued, start() may report this synchronously while startNext() is still filling slots
+        if (error == QProcess::FailedToStart)
+            QMetaObject::invokeMethod(this, [=]() { finishJob(ip, -1, "Failed to start plink."); }, Qt::QueuedConnection);
+    });
+
+    QTimer::singleShot(job.timeoutMs, process, [=]() {
+        if (process->state() == QProcess::NotRunning) return;
+        process->setProperty("timedOut", true);
+        process->kill();
+    });
+
+    process->start(plinkPath, arguments);
+}
+
+void PlinkFanOut::finishJob(const QString& ip, int exitCode, const QString& error)
+{
+    auto it = running.find(ip);
+    if (it == running.end()) return;
+
+    Job job = it.value();
+    running.erase(it);
+    if (job.process) {
+        job.process->disconnect(this);
+        job.process->deleteLater();
+    }
+
+    // A stale key (board reflashed) fails every job, the next one fetches it again
+    if (exitCode != 0)
+        hostKeys.remove(ip);
+
+    emit jobFinished(job.id, ip, exitCode, error);
+
+    startNext();
+}
@@ -0,0 +1,58 @@
+#ifndef PLINKFANOUT_H
+#define PLINKFANOUT_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QProcess>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <QtConcurrent>
+#include "firmwareupdater.h"
+
+// Runs plink commands on many boards with bounded parallelism, shared by all fleet tools.
+// Host keys are fetched off the GUI thread once and cached until a job on that board fails,
+// stuck commands are killed after the timeout. Signals carry the job id returned by run().
+class PlinkFanOut : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PlinkFanOut(QObject *parent,
+                         const QString& user,
+                         const QString& password,
+                         const QString& plink,
+                         int maxParallel = 32);
+
+    int run(const QString& ip, const QString& command, int timeoutMs);
+
+signals:
+    void outputReady(int jobId, const QString& ip, const QByteArray& data, bool isStdErr);
+    // exitCode -1 when plink did not run to a normal exit, error says why
+    void jobFinished(int jobId, const QString& ip, int exitCode, const QString& error);
+
+private:
+    struct Job {
+        int id = 0;
+        QString ip;
+        QString command;
+        int timeoutMs = 30000;
+        QProcess* process = nullptr;    // nullptr while the host key is fetched
+    };
+
+    const QString remoteUser;
+    const QString remotePassword;
+    const QString plinkPath;
+    const int maxParallel;
+
+    int nextJobId = 1;
+    QList<Job> pending;
+    QHash<QString, Job> running;        // by ip, one job per board at a time
+    QHash<QString, QString> hostKeys;   // cached, dropped when a job fails (e.g. board reflashed)
+
+    void startNext();
+    void startProcess(const Job& job, const QString& hostKey);
+    void finishJob(const QString& ip, int exitCode, const QString& error);
+};
+#endif // PLINKFANOUT_H